@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <string>
+
+/*
+    协作式取消。CancellationSource::cancel()一次原子写即可取消它发出的所有token，
+    用同一个source提交的一批任务就是一个取消组；子source在父token取消时一并取消。
+    isCancelled()只是沿父链的几次原子读，运行中的任务可以频繁轮询。
+*/
+class CancellationToken{
+    private:
+        friend class CancellationSource;
+
+        struct State{
+            std::atomic<bool> cancelled;
+            std::shared_ptr<State> parent;
+            State(std::shared_ptr<State> p): cancelled(false), parent(std::move(p)) {}
+        };
+        std::shared_ptr<State> state;
+
+        CancellationToken(std::shared_ptr<State> s): state(std::move(s)) {}
+    public:
+        //默认构造的token永远不会被取消
+        CancellationToken() {}
+
+        bool canBeCancelled() const {
+            return state != nullptr;
+        }
+        bool isCancelled() const {
+            for(State* s = state.get(); s; s = s->parent.get()){
+                if(s->cancelled.load(std::memory_order_acquire)) return true;
+            }
+            return false;
+        }
+};
+
+class CancellationSource{
+    private:
+        std::shared_ptr<CancellationToken::State> state;
+    public:
+        CancellationSource()
+        : state(std::make_shared<CancellationToken::State>(nullptr)) {}
+        //parent被取消时，这个source发出的token也视为取消
+        explicit CancellationSource(const CancellationToken& parent)
+        : state(std::make_shared<CancellationToken::State>(parent.state)) {}
+
+        CancellationToken token() const {
+            return CancellationToken(state);
+        }
+        void cancel(){
+            state->cancelled.store(true, std::memory_order_release);
+        }
+        bool isCancelled() const {
+            return token().isCancelled();
+        }
+};
+
+//任务在开始执行前被取消，future.get()抛出
+class TaskCancelledException: public std::exception {
+    private:
+        std::string message;
+    public:
+        TaskCancelledException(): message("Task cancelled before it started.") {}
+        const char* what() const noexcept override {
+            return message.c_str();
+        }
+};
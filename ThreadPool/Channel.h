@@ -0,0 +1,406 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <random>
+
+#include "ThreadPool.h"
+#include "RingBuffer.h"
+
+/*
+    Go风格的有界MPMC通道，缓冲区复用任务队列的环形缓冲区。
+    send/recv阻塞当前线程，try*不阻塞；asyncRecv/asyncSend不占用线程：
+    暂时不能完成时只登记一个等待者，数据(或空位)到达后由对端把续体投递到线程池。
+    close后send失败，recv取完剩余数据后返回关闭。Channel析构时自动close。
+*/
+
+//等待者，被唤醒时调用wake；select同时登记在多个通道上，fired保证只被唤醒一次
+struct ChannelWaiter{
+    std::atomic<bool> fired{false};
+    std::function<void()> wake;     //在对端线程中调用，不能阻塞
+};
+
+/*
+    等待者队列。等待方先登记再重查通道，唤醒方先改通道再查count，两边都是顺序一致的原子操作，不会丢唤醒。
+    唤醒只是让等待方重试，数据可能被别人先取走，等待方重新登记即可。
+    select被一个通道唤醒后可能执行了另一个通道的case，这时要把唤醒传给仍就绪的通道上的其他等待者。
+*/
+class WaitQueue{
+    private:
+        std::deque<std::shared_ptr<ChannelWaiter>> q;
+        std::atomic<int> count{0};
+        std::mutex mtx;
+
+    public:
+        void enlist(std::shared_ptr<ChannelWaiter> w){
+            std::lock_guard<std::mutex> lock(mtx);
+            //清掉已在其他通道上被唤醒的select等待者
+            q.erase(std::remove_if(q.begin(), q.end(), [](const std::shared_ptr<ChannelWaiter>& n){
+                return n->fired.load();
+            }), q.end());
+            q.push_back(std::move(w));
+            count.store(int(q.size()));
+        }
+        void wakeOne(){
+            if(count.load() == 0) return;
+            std::shared_ptr<ChannelWaiter> w;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                while(!q.empty()){
+                    std::shared_ptr<ChannelWaiter> n = std::move(q.front());
+                    q.pop_front();
+                    if(!n->fired.exchange(true)){
+                        w = std::move(n);
+                        break;
+                    }
+                }
+                count.store(int(q.size()));
+            }
+            //锁外唤醒，wake可能向线程池投递任务
+            if(w) w->wake();
+        }
+        void wakeAll(){
+            std::deque<std::shared_ptr<ChannelWaiter>> all;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                all.swap(q);
+                count.store(0);
+            }
+            for(auto& n: all){
+                if(!n->fired.exchange(true)) n->wake();
+            }
+        }
+};
+
+//阻塞等待：登记后重查，没有就绪才睡眠
+template<typename Ready>
+void channelBlock(const std::vector<WaitQueue*>& queues, Ready ready){
+    struct Sync{
+        std::mutex m;
+        std::condition_variable cv;
+        bool ready = false;
+    };
+    auto sync = std::make_shared<Sync>();
+    auto node = std::make_shared<ChannelWaiter>();
+    node->wake = [sync](){
+        std::lock_guard<std::mutex> lock(sync->m);
+        sync->ready = true;
+        sync->cv.notify_one();
+    };
+    for(WaitQueue* q: queues){
+        q->enlist(node);
+    }
+    //已就绪且没人唤醒过，撤销等待直接重试
+    if(ready() && !node->fired.exchange(true)) return;
+    std::unique_lock<std::mutex> lock(sync->m);
+    sync->cv.wait(lock, [&](){ return sync->ready; });
+}
+
+template<typename T, typename Lock = SpinLock>
+class Channel{
+    private:
+        friend class Select;
+
+        struct Impl{
+            RingBuffer<T, Lock> ring;
+            std::atomic<bool> closed{false};
+            WaitQueue recvq, sendq;
+
+            explicit Impl(int capacity): ring(capacity) {}
+
+            bool tryRecv(T& v){
+                if(!ring.pop(v)) return false;
+                sendq.wakeOne();
+                return true;
+            }
+            //失败时不移动v
+            bool trySend(T&& v){
+                if(closed.load() || !ring.push(std::move(v))) return false;
+                recvq.wakeOne();
+                return true;
+            }
+            bool recvReady(){
+                return !ring.empty() || closed.load();
+            }
+            bool sendReady(){
+                return !ring.full() || closed.load();
+            }
+            void close(){
+                closed.store(true);
+                recvq.wakeAll();
+                sendq.wakeAll();
+            }
+            //关闭后先取完剩余数据；返回false表示暂时无法完成
+            bool recvOrClosed(std::optional<T>& out){
+                T v;
+                if(tryRecv(v)){
+                    out = std::move(v);
+                    return true;
+                }
+                if(!closed.load()) return false;
+                if(tryRecv(v)) out = std::move(v);
+                return true;
+            }
+        };
+        std::shared_ptr<Impl> impl;
+
+        //异步收发的续体，数据到达前只挂在等待者队列上
+        struct RecvOp{
+            std::shared_ptr<Impl> ch;
+            ThreadPool* pool;
+            std::function<void(std::optional<T>)> handler;
+
+            static void attempt(const std::shared_ptr<RecvOp>& op){
+                while(true){
+                    std::optional<T> v;
+                    if(op->ch->recvOrClosed(v)){
+                        auto box = std::make_shared<std::optional<T>>(std::move(v));
+                        op->pool->post([op, box](){ op->handler(std::move(*box)); });
+                        return;
+                    }
+                    auto node = std::make_shared<ChannelWaiter>();
+                    node->wake = [op](){ op->pool->post([op](){ attempt(op); }); };
+                    op->ch->recvq.enlist(node);
+                    if(!op->ch->recvReady() || node->fired.exchange(true)) return;
+                }
+            }
+        };
+        struct SendOp{
+            std::shared_ptr<Impl> ch;
+            ThreadPool* pool;
+            T value;
+            std::function<void(bool)> done;
+
+            static void attempt(const std::shared_ptr<SendOp>& op){
+                while(true){
+                    bool closed = op->ch->closed.load();
+                    if(closed || op->ch->trySend(std::move(op->value))){
+                        if(op->done){
+                            op->pool->post([op, closed](){ op->done(!closed); });
+                        }
+                        return;
+                    }
+                    auto node = std::make_shared<ChannelWaiter>();
+                    node->wake = [op](){ op->pool->post([op](){ attempt(op); }); };
+                    op->ch->sendq.enlist(node);
+                    if(!op->ch->sendReady() || node->fired.exchange(true)) return;
+                }
+            }
+        };
+
+    public:
+        explicit Channel(int capacity)
+        : impl(std::make_shared<Impl>(capacity)) {}
+        ~Channel(){
+            impl->close();
+        }
+
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        //阻塞发送，通道关闭返回false。在本线程池的任务中应使用asyncSend，或包在pool.blocking()中
+        bool send(T v){
+            while(true){
+                if(impl->closed.load()) return false;
+                if(impl->trySend(std::move(v))) return true;
+                channelBlock({&impl->sendq}, [this](){ return impl->sendReady(); });
+            }
+        }
+        //阻塞接收，通道关闭且已取空返回false
+        bool recv(T& v){
+            while(true){
+                std::optional<T> res;
+                if(impl->recvOrClosed(res)){
+                    if(!res) return false;
+                    v = std::move(*res);
+                    return true;
+                }
+                channelBlock({&impl->recvq}, [this](){ return impl->recvReady(); });
+            }
+        }
+
+        //缓冲区满或通道关闭时返回false，不移动v
+        bool trySend(T&& v){
+            return impl->trySend(std::move(v));
+        }
+        bool trySend(const T& v){
+            T copy = v;
+            return impl->trySend(std::move(copy));
+        }
+        bool tryRecv(T& v){
+            return impl->tryRecv(v);
+        }
+
+        /*
+            数据到达后handler作为任务在pool中执行，通道关闭且取空时得到nullopt。
+            等待期间不占用任何线程。
+        */
+        void asyncRecv(ThreadPool& pool, std::function<void(std::optional<T>)> handler){
+            auto op = std::make_shared<RecvOp>();
+            op->ch = impl;
+            op->pool = &pool;
+            op->handler = std::move(handler);
+            RecvOp::attempt(op);
+        }
+        //发送完成后done(true)在pool中执行，通道关闭时done(false)
+        void asyncSend(ThreadPool& pool, T v, std::function<void(bool)> done = nullptr){
+            auto op = std::make_shared<SendOp>();
+            op->ch = impl;
+            op->pool = &pool;
+            op->value = std::move(v);
+            op->done = std::move(done);
+            SendOp::attempt(op);
+        }
+
+        void close(){
+            impl->close();
+        }
+        bool isClosed(){
+            return impl->closed.load();
+        }
+        int size(){
+            return impl->ring.size();
+        }
+        int capacity(){
+            return impl->ring.capacity();
+        }
+};
+
+template<typename T>
+using BlockChannel = Channel<T, std::mutex>;
+
+/*
+    多路选择，一次执行一个就绪的case。同Go一样从随机的case开始轮询，循环中每轮新建Select也不会饿死后面的通道。
+    recv case在通道关闭且取空时得到nullopt；send case的值只发送一次，通道关闭时handler(false)。
+    wait阻塞调用线程；async不占用线程，选中的handler在线程池中执行。
+*/
+class Select{
+    private:
+        struct Case{
+            std::function<bool()> attempt;      //成功时已执行handler
+            std::function<bool()> ready;
+            WaitQueue* queue;
+        };
+        std::vector<Case> cases;
+        size_t next;
+
+        static bool tryCases(std::vector<Case>& cases, size_t& next){
+            for(size_t i = 0; i < cases.size(); ++i){
+                size_t k = (next + i) % cases.size();
+                if(cases[k].attempt()){
+                    next = k + 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+        //执行了done号case后，其他仍就绪的通道唤醒一个等待者，补上可能被本select占掉的唤醒
+        static void passWakeups(std::vector<Case>& cases, size_t done){
+            for(size_t i = 0; i < cases.size(); ++i){
+                if(i != done && cases[i].ready()) cases[i].queue->wakeOne();
+            }
+        }
+        static bool anyReady(std::vector<Case>& cases){
+            for(auto& c: cases){
+                if(c.ready()) return true;
+            }
+            return false;
+        }
+        std::vector<WaitQueue*> queues(){
+            std::vector<WaitQueue*> res;
+            for(auto& c: cases){
+                res.push_back(c.queue);
+            }
+            return res;
+        }
+
+        struct AsyncOp{
+            std::vector<Case> cases;
+            size_t next;
+            ThreadPool* pool;
+
+            static void attempt(const std::shared_ptr<AsyncOp>& op){
+                while(true){
+                    if(tryCases(op->cases, op->next)){
+                        passWakeups(op->cases, op->next - 1);
+                        return;
+                    }
+                    auto node = std::make_shared<ChannelWaiter>();
+                    node->wake = [op](){ op->pool->post([op](){ attempt(op); }); };
+                    for(auto& c: op->cases){
+                        c.queue->enlist(node);
+                    }
+                    if(!anyReady(op->cases) || node->fired.exchange(true)) return;
+                }
+            }
+        };
+
+    public:
+        Select(){
+            static thread_local std::minstd_rand rng(std::random_device{}());
+            next = rng();
+        }
+
+        //handler签名为void(std::optional<T>)
+        template<typename T, typename Lock, typename F>
+        Select& recv(Channel<T, Lock>& ch, F handler){
+            auto impl = ch.impl;
+            cases.push_back(Case{
+                [impl, handler](){
+                    std::optional<T> v;
+                    if(!impl->recvOrClosed(v)) return false;
+                    handler(std::move(v));
+                    return true;
+                },
+                [impl](){ return impl->recvReady(); },
+                &impl->recvq
+            });
+            return *this;
+        }
+
+        template<typename T, typename Lock>
+        Select& send(Channel<T, Lock>& ch, typename std::enable_if<true, T>::type v, std::function<void(bool)> handler = nullptr){
+            auto impl = ch.impl;
+            auto box = std::make_shared<T>(std::move(v));
+            cases.push_back(Case{
+                [impl, box, handler](){
+                    bool closed = impl->closed.load();
+                    if(!closed && !impl->trySend(std::move(*box))) return false;
+                    if(handler) handler(!closed);
+                    return true;
+                },
+                [impl](){ return impl->sendReady(); },
+                &impl->sendq
+            });
+            return *this;
+        }
+
+        //没有就绪的case时返回false，相当于Go的default分支
+        bool trySelect(){
+            return tryCases(cases, next);
+        }
+        //阻塞直到执行了一个case，没有case时立即返回
+        void wait(){
+            if(cases.empty()) return;
+            while(!tryCases(cases, next)){
+                channelBlock(queues(), [this](){ return anyReady(cases); });
+            }
+            passWakeups(cases, next - 1);
+        }
+        //Select的case被移交给线程池，之后不能再使用这个Select
+        void async(ThreadPool& pool){
+            if(cases.empty()) return;
+            auto op = std::make_shared<AsyncOp>();
+            op->cases = std::move(cases);
+            op->next = next;
+            op->pool = &pool;
+            cases.clear();
+            pool.post([op](){ AsyncOp::attempt(op); });
+        }
+};
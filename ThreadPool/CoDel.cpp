@@ -0,0 +1,68 @@
+#include "CoDel.h"
+
+
+void CoDelAdmission::enable(std::chrono::nanoseconds target, std::chrono::nanoseconds interval){
+    targetNs.store(target.count());
+    intervalNs.store(interval.count());
+    firstAbove.store(0);
+    firstBelow.store(0);
+    windowStart.store(now());
+    windowCount.store(0);
+    admitLimit.store(1);
+    dropping.store(false);
+    enabled.store(true);
+}
+
+void CoDelAdmission::disable(){
+    enabled.store(false);
+    dropping.store(false);
+}
+
+void CoDelAdmission::onDequeue(int64_t enqueueNs){
+    int64_t t = now();
+    int64_t target = targetNs.load(std::memory_order_relaxed);
+    int64_t interval = intervalNs.load(std::memory_order_relaxed);
+
+    //每个interval统计一次出队速率，换算成target时间内能处理的任务数
+    windowCount.fetch_add(1, std::memory_order_relaxed);
+    int64_t start = windowStart.load(std::memory_order_relaxed);
+    if(t - start >= interval && windowStart.compare_exchange_strong(start, t)){
+        int64_t count = windowCount.exchange(0);
+        int64_t limit = count * target / (t - start);
+        admitLimit.store(limit > 1 ? int(limit) : 1, std::memory_order_relaxed);
+    }
+
+    int64_t sojourn = t - enqueueNs;
+    if(dropping.load(std::memory_order_relaxed)){
+        //过载期间排队时间维持在target附近，连续一个interval低于target/2才认为拥塞解除
+        if(sojourn >= target / 2){
+            firstBelow.store(0, std::memory_order_relaxed);
+            return;
+        }
+        int64_t below = firstBelow.load(std::memory_order_relaxed);
+        if(below == 0){
+            firstBelow.compare_exchange_strong(below, t + interval);
+        }else if(t >= below){
+            firstAbove.store(0, std::memory_order_relaxed);
+            dropping.store(false, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    if(sojourn < target){
+        firstAbove.store(0, std::memory_order_relaxed);
+        return;
+    }
+    int64_t above = firstAbove.load(std::memory_order_relaxed);
+    if(above == 0){
+        firstAbove.compare_exchange_strong(above, t + interval);
+    }else if(t >= above){
+        firstBelow.store(0, std::memory_order_relaxed);
+        dropping.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool CoDelAdmission::admit(int queueLen) const {
+    if(!dropping.load(std::memory_order_relaxed)) return true;
+    return queueLen < admitLimit.load(std::memory_order_relaxed);
+}
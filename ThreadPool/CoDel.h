@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+    基于排队时间的CoDel式准入控制。
+    worker取出任务时上报排队时间：排队时间连续一个interval都高于target，说明队列形成了常驻延迟，进入过载状态；
+    连续一个interval低于target/2才退出。过载期间按最近一个interval的出队速率估算target时间内能处理的任务数，
+    队列长度超过它时submit直接拒绝，使常驻延迟维持在target附近而不是无限增长。
+*/
+class CoDelAdmission{
+    private:
+        std::atomic<bool> enabled, dropping;
+        std::atomic<int64_t> targetNs, intervalNs;
+        std::atomic<int64_t> firstAbove;    //排队时间高于target后，再过interval的时间点，0表示低于target
+        std::atomic<int64_t> firstBelow;    //过载期间排队时间低于target/2后，再过interval的时间点
+        std::atomic<int64_t> windowStart;
+        std::atomic<int> windowCount, admitLimit;
+
+    public:
+        CoDelAdmission()
+        : enabled(false), dropping(false), targetNs(0), intervalNs(0), firstAbove(0), firstBelow(0), windowStart(0), windowCount(0), admitLimit(1) {}
+
+        static int64_t now(){
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void enable(std::chrono::nanoseconds target, std::chrono::nanoseconds interval);
+        void disable();
+        bool isEnabled() const {
+            return enabled.load(std::memory_order_relaxed);
+        }
+        bool overloaded() const {
+            return dropping.load(std::memory_order_relaxed);
+        }
+
+        //worker取出任务时调用，enqueueNs为入队时间
+        void onDequeue(int64_t enqueueNs);
+        //submit时调用，返回false表示拒绝
+        bool admit(int queueLen) const;
+};
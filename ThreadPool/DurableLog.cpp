@@ -0,0 +1,363 @@
+#include "DurableLog.h"
+
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace{
+    const uint64_t logMagic = 0x3136304c4f475631ULL;    //"160LOGV1"
+    const uint32_t logVersion = 1;
+    const uint32_t padHandler = 0xffffffffu;
+    const size_t headerLen = 4096;
+
+    uint32_t crc32(uint32_t crc, const void* buf, size_t len){
+        static uint32_t table[256] = {0};
+        static std::once_flag once;
+        std::call_once(once, [](){
+            for(uint32_t i = 0; i < 256; ++i){
+                uint32_t c = i;
+                for(int k = 0; k < 8; ++k){
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+        });
+        const unsigned char* p = static_cast<const unsigned char*>(buf);
+        crc = ~crc;
+        for(size_t i = 0; i < len; ++i){
+            crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    size_t pageFloor(size_t off){
+        size_t page = size_t(sysconf(_SC_PAGESIZE));
+        return off / page * page;
+    }
+}
+
+struct DurableLog::Header{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t head;          //最老未确认记录的逻辑位置
+    uint64_t headSeq;       //它的序号
+};
+
+struct DurableLog::RecordHeader{
+    uint32_t size;          //负载字节数
+    uint32_t handler;       //padHandler为填充记录
+    uint64_t seq;
+    uint32_t crc;           //覆盖size、handler、seq和负载
+    uint32_t acked;         //不参与校验
+};
+
+DurableLog::DurableLog(const std::string& path, const DurableOptions& options)
+: fd(-1), base(nullptr), data(nullptr), mapLen(0), cap(0), header(nullptr), opt(options),
+  head(0), tail(0), headSeq(0), tailSeq(0), syncFrom(0), headerDirty(false), unsynced(0),
+  lastSync(std::chrono::steady_clock::now()), synced(0), stopping(false)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "fstat " + path);
+    }
+    bool fresh = st.st_size == 0;
+    if(fresh){
+        cap = (options.capacity + headerLen - 1) / headerLen * headerLen;
+        if(cap == 0) cap = headerLen;
+        if(ftruncate(fd, off_t(headerLen + cap)) != 0){
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "ftruncate " + path);
+        }
+        mapLen = headerLen + cap;
+    }else{
+        mapLen = size_t(st.st_size);
+    }
+    void* p = mmap(nullptr, mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED){
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "mmap " + path);
+    }
+    base = static_cast<char*>(p);
+    header = reinterpret_cast<Header*>(base);
+    data = base + headerLen;
+    if(fresh){
+        header->magic = logMagic;
+        header->version = logVersion;
+        header->reserved = 0;
+        header->capacity = cap;
+        header->head = 0;
+        header->headSeq = 0;
+        msync(base, headerLen, MS_SYNC);
+    }else if(mapLen < headerLen || header->magic != logMagic || header->version != logVersion
+     || header->capacity + headerLen != mapLen){
+        munmap(base, mapLen);
+        close(fd);
+        throw std::runtime_error("DurableLog: bad file " + path);
+    }
+    cap = size_t(header->capacity);
+    recover();
+    //interval为0时每次追加都会刷盘
+    if(opt.sync == DurableSync::BATCH && opt.interval.count() > 0){
+        flusher = std::thread(&DurableLog::flushLoop, this);
+    }
+}
+
+DurableLog::~DurableLog(){
+    if(flusher.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cvOfFlush.notify_one();
+        flusher.join();
+    }
+    sync();
+    munmap(base, mapLen);
+    close(fd);
+}
+
+DurableLog::RecordHeader* DurableLog::at(uint64_t pos){
+    return reinterpret_cast<RecordHeader*>(data + pos % cap);
+}
+
+size_t DurableLog::recordLen(size_t payload){
+    return (sizeof(RecordHeader) + payload + 7) & ~size_t(7);
+}
+
+//从头部扫描出尾部，序号不连续或校验失败的记录是上一圈的残留或写了一半
+void DurableLog::recover(){
+    head = header->head;
+    headSeq = header->headSeq;
+    tail = head;
+    tailSeq = headSeq;
+    while(tail - head < cap){
+        size_t phys = size_t(tail % cap);
+        if(cap - phys < sizeof(RecordHeader)){
+            tail += cap - phys;
+            continue;
+        }
+        RecordHeader* rec = at(tail);
+        size_t len = recordLen(rec->size);
+        if(rec->seq != tailSeq || len > cap - phys || tail - head + len > cap) break;
+        uint32_t crc = crc32(0, rec, offsetof(RecordHeader, crc));
+        if(rec->handler != padHandler){
+            crc = crc32(crc, rec + 1, rec->size);
+        }
+        if(crc != rec->crc) break;
+        tail += len;
+        ++tailSeq;
+    }
+    syncFrom = tail;
+    synced = tail;
+    advanceHead();
+}
+
+bool DurableLog::append(uint32_t handler, const void* payload, size_t len, uint64_t& pos){
+    size_t need = recordLen(len);
+    if(len > UINT32_MAX || need > cap){
+        throw std::length_error("DurableLog: record larger than capacity");
+    }
+    uint64_t from, to, end;
+    bool flush = false, flushHeader = false, wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t phys = size_t(tail % cap);
+        size_t pad = cap - phys < need ? cap - phys : 0;
+        //日志为空时直接跳过末尾，不需要填充；头部要先于这条记录落盘，否则恢复时从旧位置扫描不到它
+        if(pad && head == tail){
+            tail += pad;
+            head = tail;
+            header->head = head;
+            headerDirty = true;
+            pad = 0;
+        }
+        if(tail - head + pad + need > cap) return false;
+        if(pad >= sizeof(RecordHeader)){
+            RecordHeader* rec = at(tail);
+            rec->size = uint32_t(pad - sizeof(RecordHeader));
+            rec->handler = padHandler;
+            rec->seq = tailSeq++;
+            rec->acked = 1;
+            rec->crc = crc32(0, rec, offsetof(RecordHeader, crc));
+        }
+        tail += pad;
+        pos = tail;
+        RecordHeader* rec = at(tail);
+        rec->size = uint32_t(len);
+        rec->handler = handler;
+        rec->seq = tailSeq++;
+        rec->acked = 0;
+        std::memcpy(rec + 1, payload, len);
+        rec->crc = crc32(crc32(0, rec, offsetof(RecordHeader, crc)), payload, len);
+        tail += need;
+        end = tail;
+
+        if(opt.sync == DurableSync::BATCH){
+            auto now = std::chrono::steady_clock::now();
+            if(++unsynced >= opt.batchSize || now - lastSync >= opt.interval){
+                from = syncFrom;
+                to = tail;
+                syncFrom = tail;
+                flushHeader = headerDirty;
+                headerDirty = false;
+                unsynced = 0;
+                lastSync = now;
+                flush = true;
+            }else if(unsynced == 1){
+                //这一批的第一条，由刷盘线程保证interval内落盘
+                wake = true;
+            }
+        }
+    }
+    if(wake) cvOfFlush.notify_one();
+    if(opt.sync == DurableSync::ALWAYS){
+        syncTo(end);
+    }else if(flush){
+        //锁外刷盘，多个提交者的范围可以重叠
+        if(flushHeader) msync(base, headerLen, MS_SYNC);
+        syncRange(from, to);
+    }
+    return true;
+}
+
+//刷盘到end为止，从最老的未刷盘位置开始，包括填充记录和其他提交者还没刷的记录
+void DurableLog::syncTo(uint64_t end){
+    std::lock_guard<std::mutex> slock(syncMtx);
+    //前一个刷盘者已经覆盖了这条记录
+    if(synced >= end) return;
+    uint64_t from, to;
+    bool flushHeader;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        from = syncFrom;
+        to = tail;
+        syncFrom = tail;
+        flushHeader = headerDirty;
+        headerDirty = false;
+    }
+    if(flushHeader) msync(base, headerLen, MS_SYNC);
+    syncRange(from, to);
+    synced = to;
+}
+
+//BATCH下提交停下来时，不足batchSize条的记录在距上次刷盘interval后刷盘
+void DurableLog::flushLoop(){
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true){
+        cvOfFlush.wait(lock, [this](){ return stopping || unsynced > 0; });
+        if(stopping) return;
+        if(cvOfFlush.wait_until(lock, lastSync + opt.interval, [this](){ return stopping; })) return;
+        //等待期间提交者或sync可能已经刷过
+        auto now = std::chrono::steady_clock::now();
+        if(unsynced == 0 || now - lastSync < opt.interval) continue;
+        uint64_t from = syncFrom, to = tail;
+        bool flushHeader = headerDirty;
+        syncFrom = tail;
+        headerDirty = false;
+        unsynced = 0;
+        lastSync = now;
+        lock.unlock();
+        if(flushHeader) msync(base, headerLen, MS_SYNC);
+        syncRange(from, to);
+        lock.lock();
+    }
+}
+
+void DurableLog::ack(uint64_t pos){
+    std::lock_guard<std::mutex> lock(mtx);
+    at(pos)->acked = 1;
+    if(pos == head) advanceHead();
+}
+
+//头部越过连续的已确认记录，调用方持有mtx或在构造中
+void DurableLog::advanceHead(){
+    while(head < tail){
+        size_t phys = size_t(head % cap);
+        if(cap - phys < sizeof(RecordHeader)){
+            head += cap - phys;
+            continue;
+        }
+        RecordHeader* rec = at(head);
+        if(!rec->acked) break;
+        head += recordLen(rec->size);
+        headSeq = rec->seq + 1;
+    }
+    header->head = head;
+    header->headSeq = headSeq;
+}
+
+std::vector<DurableRecord> DurableLog::pending(){
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<DurableRecord> res;
+    uint64_t pos = head;
+    while(pos < tail){
+        size_t phys = size_t(pos % cap);
+        if(cap - phys < sizeof(RecordHeader)){
+            pos += cap - phys;
+            continue;
+        }
+        RecordHeader* rec = at(pos);
+        if(!rec->acked && rec->handler != padHandler){
+            res.push_back(DurableRecord{pos, rec->handler, std::string(reinterpret_cast<char*>(rec + 1), rec->size)});
+        }
+        pos += recordLen(rec->size);
+    }
+    return res;
+}
+
+void DurableLog::syncRange(uint64_t from, uint64_t to){
+    if(from >= to) return;
+    if(to - from >= cap){
+        msync(data, cap, MS_SYNC);
+        return;
+    }
+    //按映射内的绝对偏移对齐页
+    auto flush = [this](size_t a, size_t b){
+        size_t start = pageFloor(headerLen + a);
+        msync(base + start, headerLen + b - start, MS_SYNC);
+    };
+    size_t a = size_t(from % cap), b = size_t(to % cap);
+    if(b == 0) b = cap;
+    if(a < b){
+        flush(a, b);
+    }else{
+        flush(a, cap);
+        flush(0, b);
+    }
+}
+
+void DurableLog::sync(){
+    std::lock_guard<std::mutex> slock(syncMtx);
+    uint64_t to;
+    {
+        //先取尾部再刷盘，之后追加的记录留给下一次刷盘
+        std::lock_guard<std::mutex> lock(mtx);
+        to = tail;
+        syncFrom = tail;
+        headerDirty = false;
+        unsynced = 0;
+        lastSync = std::chrono::steady_clock::now();
+    }
+    msync(base, mapLen, MS_SYNC);
+    synced = to;
+}
+
+size_t DurableLog::used(){
+    std::lock_guard<std::mutex> lock(mtx);
+    return size_t(tail - head);
+}
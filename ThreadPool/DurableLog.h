@@ -0,0 +1,96 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+//持久化队列的刷盘方式
+enum class DurableSync{
+    NONE,       //只写页缓存，进程崩溃不丢，掉电可能丢
+    BATCH,      //累计batchSize条或距上次刷盘超过interval时由当时的提交者msync，提交停下来时由后台线程在interval后msync
+    ALWAYS      //该记录及之前的所有记录msync后submitDurable才返回
+};
+
+struct DurableOptions{
+    size_t capacity = size_t(64) << 20;             //新建文件时的数据区字节数，已有文件沿用文件中的容量
+    DurableSync sync = DurableSync::BATCH;
+    int batchSize = 64;
+    std::chrono::milliseconds interval{10};
+};
+
+//持久化任务的执行函数，参数为提交时的负载
+using DurableHandler = std::function<void(const std::string& payload)>;
+
+//重放时取出的未确认记录
+struct DurableRecord{
+    uint64_t pos;
+    uint32_t handler;
+    std::string payload;
+};
+
+/*
+    mmap的环形日志文件。文件头一页保存容量和最老未确认记录的位置，之后是数据区。
+    记录只追加在尾部，8字节对齐，不跨越文件末尾(末尾放不下时写填充记录绕回开头)。
+    记录带递增序号和CRC，尾部位置不落盘，打开时从头部往后扫描，序号不连续或校验失败处即为尾部。
+    任务执行完后ack把记录标记为已确认，头部越过连续的已确认记录后空间被复用。
+    ack标记不单独刷盘，掉电后可能重放已执行过的任务，语义为至少一次。
+*/
+class DurableLog{
+    private:
+        struct Header;
+        struct RecordHeader;
+
+        int fd;
+        char* base;         //整个映射
+        char* data;         //数据区
+        size_t mapLen, cap;
+        Header* header;
+
+        DurableOptions opt;
+        std::mutex mtx;
+        uint64_t head, tail, headSeq, tailSeq;  //逻辑位置，物理位置为对cap取模
+        uint64_t syncFrom;                      //还没刷盘的起点，包括之前的填充记录
+        bool headerDirty;                       //头部位置跳过了末尾，还没刷盘
+        int unsynced;
+        std::chrono::steady_clock::time_point lastSync;
+        std::mutex syncMtx;                     //ALWAYS和sync的刷盘串行执行，已刷盘的范围连续
+        uint64_t synced;                        //在此之前的记录都已刷盘，持有syncMtx访问
+        //BATCH的定时刷盘线程，没有未刷盘记录时不醒来
+        std::thread flusher;
+        std::condition_variable cvOfFlush;
+        bool stopping;
+
+        RecordHeader* at(uint64_t pos);
+        static size_t recordLen(size_t payload);
+        void recover();
+        void advanceHead();
+        void syncRange(uint64_t from, uint64_t to);
+        void syncTo(uint64_t end);
+        void flushLoop();
+
+    public:
+        //打开或新建文件，失败抛std::system_error，文件格式不对抛std::runtime_error
+        DurableLog(const std::string& path, const DurableOptions& options);
+        ~DurableLog();
+
+        DurableLog(const DurableLog&) = delete;
+        DurableLog& operator=(const DurableLog&) = delete;
+
+        //追加一条记录，空间不足返回false；单条记录超过容量抛std::length_error
+        bool append(uint32_t handler, const void* payload, size_t len, uint64_t& pos);
+        void ack(uint64_t pos);
+        //打开时未确认的记录，按提交顺序
+        std::vector<DurableRecord> pending();
+        //刷盘全部数据
+        void sync();
+
+        size_t capacity() const {
+            return cap;
+        }
+        size_t used();
+};
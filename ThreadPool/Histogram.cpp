@@ -0,0 +1,77 @@
+#include "Histogram.h"
+
+LatencyHistogram::LatencyHistogram(int64_t maxTrackable, int bits)
+: subBits(bits < 2 ? 2 : bits), halfCount(0), maxValue(maxTrackable < 2 ? 2 : maxTrackable), length(0),
+ counts(nullptr), total(0), maxSeen(0), sum(0)
+{
+    halfCount = 1 << (subBits - 1);
+    length = indexOf(maxValue) + 1;
+    counts.reset(new std::atomic<int64_t>[length]);
+    reset();
+}
+
+/*
+    第0段[0, 2*halfCount)按1计数，之后第b段[2^(subBits+b-1), 2^(subBits+b))每个格子宽2^b，
+    格子编号b*halfCount + (value>>b)在各段之间连续。
+*/
+int LatencyHistogram::indexOf(int64_t value) const {
+    uint64_t v = uint64_t(value) | uint64_t(2 * halfCount - 1);
+    int msb = 63 - __builtin_clzll(v);
+    int bucket = msb - (subBits - 1);
+    return bucket * halfCount + int(uint64_t(value) >> bucket);
+}
+
+int64_t LatencyHistogram::highestOf(int index) const {
+    int bucket = index < 2 * halfCount ? 0 : index / halfCount - 1;
+    int64_t sub = index - bucket * halfCount;
+    return ((sub + 1) << bucket) - 1;
+}
+
+void LatencyHistogram::record(int64_t value){
+    if(value < 0) value = 0;
+    if(value > maxValue) value = maxValue;
+    counts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    int64_t m = maxSeen.load(std::memory_order_relaxed);
+    while(value > m && !maxSeen.compare_exchange_weak(m, value, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::recordCorrected(int64_t value, int64_t expectedInterval){
+    record(value);
+    if(expectedInterval <= 0) return;
+    for(int64_t missing = value - expectedInterval; missing >= expectedInterval; missing -= expectedInterval){
+        record(missing);
+    }
+}
+
+void LatencyHistogram::reset(){
+    for(int i = 0; i < length; ++i){
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0);
+    maxSeen.store(0);
+    sum.store(0);
+}
+
+double LatencyHistogram::mean() const {
+    int64_t n = total.load();
+    return n ? double(sum.load()) / n : 0;
+}
+
+int64_t LatencyHistogram::valueAt(double percentile) const {
+    int64_t n = total.load();
+    if(n == 0) return 0;
+    if(percentile > 100) percentile = 100;
+    int64_t target = int64_t(percentile / 100 * n + 0.5);
+    if(target < 1) target = 1;
+    int64_t seen = 0;
+    for(int i = 0; i < length; ++i){
+        seen += counts[i].load(std::memory_order_relaxed);
+        if(seen >= target){
+            int64_t v = highestOf(i);
+            return v < maxSeen.load() ? v : maxSeen.load();
+        }
+    }
+    return maxSeen.load();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+/*
+    HDR式延迟直方图，对数分段、段内线性，相对误差不超过2^-(subBits-1)。
+    计数是原子的，worker可以并发record；读取百分位时应已停止记录。
+    recordCorrected按HDR的做法补偿协调遗漏：一次耗时value的测量挡住了本应每expectedInterval到达一次的请求，
+    补记value-expectedInterval、value-2*expectedInterval...这些没有被测到的样本。
+*/
+class LatencyHistogram{
+    private:
+        int subBits, halfCount;
+        int64_t maxValue;
+        int length;
+        std::unique_ptr<std::atomic<int64_t>[]> counts;
+        std::atomic<int64_t> total, maxSeen, sum;
+
+        int indexOf(int64_t value) const;
+        int64_t highestOf(int index) const;
+
+    public:
+        //maxTrackable以上的值记为maxTrackable，subBits为段内精度位数
+        explicit LatencyHistogram(int64_t maxTrackable = int64_t(1) << 36, int subBits = 11);
+
+        void record(int64_t value);
+        void recordCorrected(int64_t value, int64_t expectedInterval);
+        void reset();
+
+        int64_t count() const {
+            return total.load();
+        }
+        int64_t max() const {
+            return maxSeen.load();
+        }
+        double mean() const;
+        //percentile取0~100，返回该百分位所在区间的上界
+        int64_t valueAt(double percentile) const;
+};
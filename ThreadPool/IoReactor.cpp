@@ -0,0 +1,394 @@
+#include "IoReactor.h"
+
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+std::unique_ptr<IoReactor> IoReactor::create(Post post, IoBackend backend){
+    if(backend != IoBackend::EPOLL){
+        std::unique_ptr<UringReactor> uring(new UringReactor(post));
+        if(uring->valid()){
+            return std::unique_ptr<IoReactor>(uring.release());
+        }
+        //显式要求io_uring时提示回退，实际使用的后端可由getIoBackend查询
+        if(backend == IoBackend::IO_URING){
+            std::cerr << "io_uring unavailable, falling back to epoll" << std::endl;
+        }
+    }
+    return std::unique_ptr<IoReactor>(new EpollReactor(post));
+}
+
+
+/*
+    io_uring实现，直接使用系统调用，不依赖liburing
+*/
+
+static int uringSetup(unsigned entries, io_uring_params* p){
+    return int(syscall(SYS_io_uring_setup, entries, p));
+}
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags){
+    return int(syscall(SYS_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+UringReactor::UringReactor(Post p, unsigned entries)
+: IoReactor(std::move(p)), ringFd(-1), sqes(nullptr), sqPtr(MAP_FAILED), cqPtr(MAP_FAILED), stopped(false)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = uringSetup(entries, &params);
+    if(fd < 0) return;
+
+    sqLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqLen = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single){
+        sqLen = cqLen = (sqLen > cqLen ? sqLen : cqLen);
+    }
+    sqesLen = params.sq_entries * sizeof(io_uring_sqe);
+
+    sqPtr = mmap(nullptr, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqPtr = single ? sqPtr : mmap(nullptr, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqesPtr = mmap(nullptr, sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqPtr == MAP_FAILED || cqPtr == MAP_FAILED || sqesPtr == MAP_FAILED){
+        if(sqesPtr != MAP_FAILED) munmap(sqesPtr, sqesLen);
+        if(!single && cqPtr != MAP_FAILED) munmap(cqPtr, cqLen);
+        if(sqPtr != MAP_FAILED) munmap(sqPtr, sqLen);
+        sqPtr = cqPtr = MAP_FAILED;
+        close(fd);
+        return;
+    }
+
+    char* sq = static_cast<char*>(sqPtr);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    sqes = static_cast<io_uring_sqe*>(sqesPtr);
+
+    char* cq = static_cast<char*>(cqPtr);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    ringFd = fd;
+    th = std::thread(&UringReactor::loop, this);
+}
+
+UringReactor::~UringReactor(){
+    if(!valid()) return;
+    stop();
+    for(Op* op: inflight){
+        delete op;
+    }
+    munmap(sqes, sqesLen);
+    if(cqPtr != sqPtr) munmap(cqPtr, cqLen);
+    munmap(sqPtr, sqLen);
+    close(ringFd);
+}
+
+//op为nullptr时提交NOP，用于唤醒reactor线程退出
+void UringReactor::submit(Op* op){
+    int err = 0;
+    {
+        std::lock_guard<std::mutex> lock(sqMtx);
+        unsigned tail = *sqTail;
+        if(stopped && op){
+            err = ECANCELED;
+        }else if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries){
+            err = EBUSY;
+        }else{
+            unsigned idx = tail & *sqMask;
+            io_uring_sqe& sqe = sqes[idx];
+            memset(&sqe, 0, sizeof(sqe));
+            if(!op){
+                sqe.opcode = IORING_OP_NOP;
+            }else{
+                sqe.fd = op->fd;
+                switch(op->kind){
+                    case OpKind::READ:
+                        sqe.opcode = IORING_OP_READ;
+                        break;
+                    case OpKind::WRITE:
+                        sqe.opcode = IORING_OP_WRITE;
+                        break;
+                    case OpKind::ACCEPT:
+                        sqe.opcode = IORING_OP_ACCEPT;
+                        sqe.accept_flags = SOCK_CLOEXEC;
+                        break;
+                }
+                if(op->kind != OpKind::ACCEPT){
+                    sqe.off = op->offset < 0 ? ~0ULL : (unsigned long long)op->offset;
+                    sqe.addr = (unsigned long long)op->buf;
+                    sqe.len = (unsigned)op->len;
+                }
+                sqe.user_data = (unsigned long long)op;
+                inflight.insert(op);
+            }
+            sqArray[idx] = idx;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+            int ret;
+            while((ret = uringEnter(ringFd, 1, 0, 0)) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)){
+                std::this_thread::yield();
+            }
+        }
+    }
+    if(err && op){
+        complete(op->handler, -err);
+        delete op;
+    }
+}
+
+void UringReactor::loop(){
+    std::vector<std::pair<Op*, int>> done;
+    bool running = true;
+    while(running){
+        if(uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            break;
+        }
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while(head != tail){
+            io_uring_cqe& cqe = cqes[head & *cqMask];
+            if(cqe.user_data == 0){
+                running = false;
+            }else{
+                done.emplace_back(reinterpret_cast<Op*>(cqe.user_data), cqe.res);
+            }
+            ++head;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        if(!done.empty()){
+            {
+                std::lock_guard<std::mutex> lock(sqMtx);
+                for(auto& d: done){
+                    inflight.erase(d.first);
+                }
+            }
+            for(auto& d: done){
+                complete(d.first->handler, d.second);
+                delete d.first;
+            }
+            done.clear();
+        }
+    }
+}
+
+void UringReactor::read(int fd, void* buf, size_t len, off_t offset, IoHandler handler){
+    submit(new Op{OpKind::READ, fd, buf, len, offset, std::move(handler)});
+}
+void UringReactor::write(int fd, const void* buf, size_t len, off_t offset, IoHandler handler){
+    submit(new Op{OpKind::WRITE, fd, const_cast<void*>(buf), len, offset, std::move(handler)});
+}
+void UringReactor::accept(int fd, IoHandler handler){
+    submit(new Op{OpKind::ACCEPT, fd, nullptr, 0, -1, std::move(handler)});
+}
+
+void UringReactor::stop(){
+    {
+        std::lock_guard<std::mutex> lock(sqMtx);
+        if(stopped) return;
+        stopped = true;
+    }
+    submit(nullptr);
+    if(th.joinable()){
+        th.join();
+    }
+}
+
+
+/*
+    epoll实现
+*/
+
+EpollReactor::EpollReactor(Post p)
+: IoReactor(std::move(p)), stopping(false)
+{
+    epFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    th = std::thread(&EpollReactor::loop, this);
+}
+
+EpollReactor::~EpollReactor(){
+    stop();
+    close(wakeFd);
+    close(epFd);
+}
+
+void EpollReactor::wake(){
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeFd, &one, sizeof(one));
+    (void)n;
+}
+
+void EpollReactor::submit(Op&& op){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!stopping.load()){
+            auto it = fds.find(op.fd);
+            if(it == fds.end()){
+                struct stat st;
+                if(fstat(op.fd, &st) == 0 && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))){
+                    fileOps.push_back(std::move(op));
+                    wake();
+                    return;
+                }
+                int flags = fcntl(op.fd, F_GETFL);
+                if(flags >= 0 && !(flags & O_NONBLOCK)){
+                    fcntl(op.fd, F_SETFL, flags | O_NONBLOCK);
+                }
+                it = fds.emplace(op.fd, FdOps()).first;
+            }
+            if(op.kind == OpKind::WRITE){
+                it->second.out.push_back(std::move(op));
+            }else{
+                it->second.in.push_back(std::move(op));
+            }
+            arm(it->first, it->second);
+            return;
+        }
+    }
+    complete(op.handler, -ECANCELED);
+}
+
+//重新注册EPOLLONESHOT事件，失败时把操作转给reactor线程处理。调用方持有mtx，返回后ops可能已失效
+void EpollReactor::arm(int fd, FdOps& ops){
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLONESHOT;
+    if(!ops.in.empty()) ev.events |= EPOLLIN;
+    if(!ops.out.empty()) ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+
+    if(ops.registered){
+        if(epoll_ctl(epFd, EPOLL_CTL_MOD, fd, &ev) == 0) return;
+    }
+    if(epoll_ctl(epFd, EPOLL_CTL_ADD, fd, &ev) == 0){
+        ops.registered = true;
+        return;
+    }
+    //不可poll(普通文件)或fd已失效：交给reactor线程直接执行，由系统调用给出结果
+    for(auto& op: ops.in) fileOps.push_back(std::move(op));
+    for(auto& op: ops.out) fileOps.push_back(std::move(op));
+    fds.erase(fd);
+    wake();
+}
+
+//执行一次非阻塞操作，EAGAIN时返回false
+bool EpollReactor::perform(Op& op, ssize_t& res){
+    ssize_t r;
+    do{
+        switch(op.kind){
+            case OpKind::READ:
+                r = op.offset >= 0 ? pread(op.fd, op.buf, op.len, op.offset) : ::read(op.fd, op.buf, op.len);
+                break;
+            case OpKind::WRITE:
+                r = op.offset >= 0 ? pwrite(op.fd, op.buf, op.len, op.offset) : ::write(op.fd, op.buf, op.len);
+                break;
+            default:
+                r = accept4(op.fd, nullptr, nullptr, SOCK_CLOEXEC);
+                break;
+        }
+    }while(r < 0 && errno == EINTR);
+
+    if(r < 0){
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return false;
+        res = -errno;
+    }else{
+        res = r;
+    }
+    return true;
+}
+
+void EpollReactor::loop(){
+    epoll_event evs[64];
+    std::vector<std::pair<IoHandler, ssize_t>> done;
+    std::deque<Op> files;
+    while(!stopping.load()){
+        int n = epoll_wait(epFd, evs, 64, -1);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(int i = 0; i < n; ++i){
+                int fd = evs[i].data.fd;
+                if(fd == wakeFd){
+                    uint64_t cnt;
+                    ssize_t r = ::read(wakeFd, &cnt, sizeof(cnt));
+                    (void)r;
+                    files.swap(fileOps);
+                    continue;
+                }
+                auto it = fds.find(fd);
+                if(it == fds.end()) continue;
+
+                for(auto* q: {&it->second.in, &it->second.out}){
+                    ssize_t res;
+                    while(!q->empty() && perform(q->front(), res)){
+                        done.emplace_back(std::move(q->front().handler), res);
+                        q->pop_front();
+                    }
+                }
+                if(it->second.in.empty() && it->second.out.empty()){
+                    epoll_ctl(epFd, EPOLL_CTL_DEL, fd, nullptr);
+                    fds.erase(it);
+                }else{
+                    arm(fd, it->second);
+                }
+            }
+        }
+
+        for(auto& op: files){
+            ssize_t res;
+            if(!perform(op, res)){
+                res = -EAGAIN;
+            }
+            done.emplace_back(std::move(op.handler), res);
+        }
+        files.clear();
+
+        for(auto& d: done){
+            complete(d.first, d.second);
+        }
+        done.clear();
+    }
+}
+
+void EpollReactor::read(int fd, void* buf, size_t len, off_t offset, IoHandler handler){
+    submit(Op{OpKind::READ, fd, buf, len, offset, std::move(handler)});
+}
+void EpollReactor::write(int fd, const void* buf, size_t len, off_t offset, IoHandler handler){
+    submit(Op{OpKind::WRITE, fd, const_cast<void*>(buf), len, offset, std::move(handler)});
+}
+void EpollReactor::accept(int fd, IoHandler handler){
+    submit(Op{OpKind::ACCEPT, fd, nullptr, 0, -1, std::move(handler)});
+}
+
+void EpollReactor::stop(){
+    if(stopping.exchange(true)) return;
+    wake();
+    if(th.joinable()){
+        th.join();
+    }
+}
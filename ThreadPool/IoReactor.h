@@ -0,0 +1,137 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include "TaskQueue.h"
+
+//完成回调，参数为读写的字节数或accept得到的fd，失败时为-errno
+using IoHandler = std::function<void(ssize_t)>;
+
+//reactor的底层实现，AUTO优先io_uring，不可用时退回epoll；IO_URING不可用时同样退回epoll并打印提示
+enum class IoBackend{
+    AUTO,
+    IO_URING,
+    EPOLL
+};
+
+/*
+    I/O反应器，单独的reactor线程等待完成事件，完成回调投递到线程池任务队列中执行。
+    读写缓冲区由调用方持有，直到回调执行。
+    stop时尚未完成的操作直接丢弃，不会执行回调。
+*/
+class IoReactor{
+    public:
+        using Post = std::function<void(CallBack&&)>;
+
+        IoReactor(Post p): post(std::move(p)) {}
+        virtual ~IoReactor() {}
+
+        //offset为-1时使用文件当前偏移(管道、socket、eventfd)
+        virtual void read(int fd, void* buf, size_t len, off_t offset, IoHandler handler) = 0;
+        virtual void write(int fd, const void* buf, size_t len, off_t offset, IoHandler handler) = 0;
+        virtual void accept(int fd, IoHandler handler) = 0;
+        virtual void stop() = 0;
+        virtual IoBackend backend() const = 0;
+
+        static std::unique_ptr<IoReactor> create(Post post, IoBackend backend = IoBackend::AUTO);
+    protected:
+        Post post;
+
+        enum class OpKind{
+            READ,
+            WRITE,
+            ACCEPT
+        };
+        struct Op{
+            OpKind kind;
+            int fd;
+            void* buf;
+            size_t len;
+            off_t offset;
+            IoHandler handler;
+        };
+
+        void complete(IoHandler& handler, ssize_t res){
+            IoHandler h = std::move(handler);
+            post([h, res](){ h(res); });
+        }
+    private:
+        IoReactor(const IoReactor&) = delete;
+        IoReactor& operator=(const IoReactor&) = delete;
+};
+
+/*
+    io_uring实现，直接使用系统调用，不依赖liburing
+*/
+class UringReactor: public IoReactor{
+    private:
+        int ringFd;
+        unsigned *sqHead, *sqTail, *sqMask, *sqArray, sqEntries;
+        unsigned *cqHead, *cqTail, *cqMask;
+        io_uring_sqe* sqes;
+        io_uring_cqe* cqes;
+        void *sqPtr, *cqPtr;
+        size_t sqLen, cqLen, sqesLen;
+
+        std::mutex sqMtx;
+        std::unordered_set<Op*> inflight;
+        std::thread th;
+        bool stopped;
+
+        void submit(Op* op);
+        void loop();
+    public:
+        UringReactor(Post p, unsigned entries = 256);
+        ~UringReactor();
+
+        //初始化失败(内核不支持或被禁用)时为false
+        bool valid() const { return ringFd >= 0; }
+
+        void read(int fd, void* buf, size_t len, off_t offset, IoHandler handler) override;
+        void write(int fd, const void* buf, size_t len, off_t offset, IoHandler handler) override;
+        void accept(int fd, IoHandler handler) override;
+        void stop() override;
+        IoBackend backend() const override { return IoBackend::IO_URING; }
+};
+
+/*
+    epoll实现，可poll的fd会被设置为O_NONBLOCK并按读写两个方向分别排队；
+    普通文件不支持epoll，在reactor线程中同步pread/pwrite
+*/
+class EpollReactor: public IoReactor{
+    private:
+        struct FdOps{
+            std::deque<Op> in, out;
+            bool registered = false;
+        };
+        int epFd, wakeFd;
+        std::mutex mtx;
+        std::unordered_map<int, FdOps> fds;
+        std::deque<Op> fileOps;
+        std::thread th;
+        std::atomic<bool> stopping;
+
+        void submit(Op&& op);
+        void arm(int fd, FdOps& ops);
+        bool perform(Op& op, ssize_t& res);
+        void wake();
+        void loop();
+    public:
+        EpollReactor(Post p);
+        ~EpollReactor();
+
+        void read(int fd, void* buf, size_t len, off_t offset, IoHandler handler) override;
+        void write(int fd, const void* buf, size_t len, off_t offset, IoHandler handler) override;
+        void accept(int fd, IoHandler handler) override;
+        void stop() override;
+        IoBackend backend() const override { return IoBackend::EPOLL; }
+};
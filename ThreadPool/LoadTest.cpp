@@ -0,0 +1,358 @@
+/*
+    开环延迟压测。按预先生成的到达时间表提交任务，不等待前一个任务完成，
+    延迟从"计划到达时间"算起，生成器落后或submit变慢都会计入延迟(协调遗漏修正)。
+    同一张时间表依次压每种任务队列和线程配置，输出submit-to-start、submit-to-finish的百分位。
+
+    LoadTest [-r 每秒任务数] [-d 秒] [-a 到达过程] [-c 任务耗时] [-t 线程数列表] [-m 最大线程数]
+             [-q 队列长度] [-T 队列类型列表] [-s 随机种子]
+    到达过程：poisson | bursty:N(每批N个，批次按泊松到达) | trace:文件(每行"到达偏移us [耗时us]")
+             | closed:K(K个闭环客户端，作为对照，按HDR期望间隔补偿)
+    任务耗时(us)：fixed:C | exp:均值 | bimodal:短,长,长任务比例 | lognormal:中位数,sigma
+    队列类型：block_queue,block_ring,lockfree_queue,lockfree_ring,fair_drr,fair_wfq
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "ThreadPool.h"
+#include "Histogram.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using Clock = std::chrono::steady_clock;
+
+//到达偏移和任务耗时，单位纳秒
+struct Arrival{
+    int64_t at;
+    int64_t cost;
+};
+
+struct LoadSpec{
+    double rate = 20000;
+    double seconds = 2;
+    std::string arrival = "poisson";
+    std::string cost = "exp:50";
+    std::vector<int> threads = {4};
+    int maxThreads = 0;
+    int queueLen = 100000;
+    std::vector<TaskQueueType> types = {TaskQueueType::BLOCK_QUEUE, TaskQueueType::BLOCK_RINGBUFFER,
+        TaskQueueType::LOCKFREE_QUEUE, TaskQueueType::LOCKFREE_RINGBUFFER, TaskQueueType::FAIR_DRR, TaskQueueType::FAIR_WFQ};
+    unsigned seed = 1;
+};
+
+struct Result{
+    LatencyHistogram start, finish, naive;
+    std::atomic<int64_t> rejected{0};
+    int64_t maxLag = 0;     //生成器最多落后计划时间多少
+};
+
+static const char* typeName(TaskQueueType tt){
+    switch (tt)
+    {
+        case TaskQueueType::BLOCK_QUEUE: return "block_queue";
+        case TaskQueueType::BLOCK_RINGBUFFER: return "block_ring";
+        case TaskQueueType::LOCKFREE_QUEUE: return "lockfree_queue";
+        case TaskQueueType::LOCKFREE_RINGBUFFER: return "lockfree_ring";
+        case TaskQueueType::FAIR_DRR: return "fair_drr";
+        case TaskQueueType::FAIR_WFQ: return "fair_wfq";
+    }
+    return "?";
+}
+
+static std::vector<std::string> split(const std::string& s, char sep){
+    std::vector<std::string> res;
+    std::stringstream ss(s);
+    std::string item;
+    while(std::getline(ss, item, sep)){
+        if(!item.empty()) res.push_back(item);
+    }
+    return res;
+}
+
+//"kind:a,b,c"拆成kind和参数
+static std::string parseSpec(const std::string& spec, std::vector<double>& args){
+    size_t pos = spec.find(':');
+    args.clear();
+    if(pos == std::string::npos) return spec;
+    std::string rest = spec.substr(pos + 1);
+    if(spec.compare(0, pos, "trace") != 0){
+        for(auto& a: split(rest, ',')) args.push_back(std::atof(a.c_str()));
+    }
+    return spec.substr(0, pos);
+}
+
+//任务耗时分布
+class CostModel{
+    private:
+        std::string kind;
+        std::vector<double> args;
+        std::exponential_distribution<double> exp;
+        std::lognormal_distribution<double> logn;
+        std::uniform_real_distribution<double> uni;
+    public:
+        explicit CostModel(const std::string& spec): uni(0, 1) {
+            kind = parseSpec(spec, args);
+            if(kind == "exp" && !args.empty()){
+                exp = std::exponential_distribution<double>(1.0 / args[0]);
+            }else if(kind == "lognormal" && args.size() >= 2){
+                logn = std::lognormal_distribution<double>(std::log(args[0]), args[1]);
+            }else if(!(kind == "fixed" && !args.empty()) && !(kind == "bimodal" && args.size() >= 3)){
+                throw std::invalid_argument("bad cost spec: " + spec);
+            }
+        }
+
+        int64_t operator()(std::mt19937_64& rng){
+            double us = args[0];
+            if(kind == "exp") us = exp(rng);
+            else if(kind == "lognormal") us = logn(rng);
+            else if(kind == "bimodal") us = uni(rng) < args[2] ? args[1] : args[0];
+            return int64_t(us * 1000);
+        }
+};
+
+//生成到达时间表，所有配置共用，保证负载完全相同
+static std::vector<Arrival> makeSchedule(const LoadSpec& spec){
+    std::mt19937_64 rng(spec.seed);
+    CostModel cost(spec.cost);
+    std::vector<double> args;
+    std::string kind = parseSpec(spec.arrival, args);
+    std::vector<Arrival> schedule;
+    int64_t end = int64_t(spec.seconds * 1e9);
+
+    if(kind == "trace"){
+        std::ifstream in(spec.arrival.substr(6));
+        if(!in) throw std::invalid_argument("cannot open trace: " + spec.arrival.substr(6));
+        std::string line;
+        while(std::getline(in, line)){
+            std::istringstream ls(line);
+            double at, us;
+            if(!(ls >> at)) continue;
+            int64_t c = (ls >> us) ? int64_t(us * 1000) : cost(rng);
+            schedule.push_back({int64_t(at * 1000), c});
+        }
+        return schedule;
+    }
+
+    int batch = 1;
+    if(kind == "bursty"){
+        batch = args.empty() || args[0] < 1 ? 16 : int(args[0]);
+    }else if(kind == "closed"){
+        //闭环只用到耗时序列
+        for(int64_t n = int64_t(spec.rate * spec.seconds); n > 0; --n){
+            schedule.push_back({0, cost(rng)});
+        }
+        return schedule;
+    }else if(kind != "poisson"){
+        throw std::invalid_argument("bad arrival spec: " + spec.arrival);
+    }
+    std::exponential_distribution<double> gap(spec.rate / batch / 1e9);
+    for(double t = gap(rng); t < end; t += gap(rng)){
+        for(int i = 0; i < batch; ++i){
+            schedule.push_back({int64_t(t), cost(rng)});
+        }
+    }
+    return schedule;
+}
+
+static int64_t toNs(Clock::duration d){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+//模拟CPU密集的任务
+static void spin(int64_t ns){
+    auto until = Clock::now() + std::chrono::nanoseconds(ns);
+    while(Clock::now() < until) {}
+}
+
+//sleep精度不够，最后一段让出CPU等待，核数少时不和worker抢
+static void waitUntil(Clock::time_point t){
+    auto now = Clock::now();
+    if(t - now > std::chrono::microseconds(200)){
+        std::this_thread::sleep_for(t - now - std::chrono::microseconds(100));
+    }
+    while(Clock::now() < t){
+        std::this_thread::yield();
+    }
+}
+
+static void runOpen(ThreadPool& pool, const std::vector<Arrival>& schedule, Result& r){
+    auto t0 = Clock::now() + std::chrono::milliseconds(10);
+    for(const Arrival& a: schedule){
+        auto intended = t0 + std::chrono::nanoseconds(a.at);
+        waitUntil(intended);
+        auto submitted = Clock::now();
+        int64_t lag = toNs(submitted - intended);
+        if(lag > r.maxLag) r.maxLag = lag;
+
+        int64_t cost = a.cost;
+        auto fut = pool.submit([&r, intended, submitted, cost](){
+            auto s = Clock::now();
+            r.start.record(toNs(s - intended));
+            spin(cost);
+            auto f = Clock::now();
+            r.finish.record(toNs(f - intended));
+            r.naive.record(toNs(f - submitted));
+        });
+        if(!fut.valid()) r.rejected.fetch_add(1);
+    }
+}
+
+/*
+    K个客户端各自按rate/K的节奏提交并等待结果。响应超过一个间隔时后面的请求被推迟发出，
+    naive只记录实际测到的样本，start/finish按期望间隔补记被挡住的样本。
+*/
+static void runClosed(ThreadPool& pool, const std::vector<Arrival>& schedule, int clients, double rate, Result& r){
+    int64_t interval = int64_t(1e9 * clients / rate);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < clients; ++i){
+        threads.emplace_back([&, i](){
+            auto planned = Clock::now() + std::chrono::nanoseconds(interval * i / clients);
+            size_t k;
+            while((k = next.fetch_add(1)) < schedule.size()){
+                waitUntil(planned);
+                auto submitted = Clock::now();
+                int64_t cost = schedule[k].cost;
+                Clock::time_point started;
+                auto fut = pool.submit([&started, cost](){
+                    started = Clock::now();
+                    spin(cost);
+                });
+                if(!fut.valid()){
+                    r.rejected.fetch_add(1);
+                }else{
+                    fut.get();
+                    auto f = Clock::now();
+                    r.start.recordCorrected(toNs(started - submitted), interval);
+                    r.finish.recordCorrected(toNs(f - submitted), interval);
+                    r.naive.record(toNs(f - submitted));
+                }
+                planned += std::chrono::nanoseconds(interval);
+                //落后时立即发下一个，这正是闭环测试遗漏的部分
+                if(planned < Clock::now()) planned = Clock::now();
+            }
+        });
+    }
+    for(auto& th: threads){
+        th.join();
+    }
+}
+
+static void printRow(const char* name, const LatencyHistogram& h){
+    double ps[] = {50, 90, 99, 99.9, 99.99};
+    cout << "  " << std::left << std::setw(8) << name << std::right;
+    for(double p: ps){
+        cout << std::setw(11) << h.valueAt(p) / 1000.0;
+    }
+    cout << std::setw(11) << h.max() / 1000.0 << std::setw(11) << h.mean() / 1000.0 << endl;
+}
+
+static void usage(const char* prog){
+    cerr << "usage: " << prog << " [-r rate] [-d seconds] [-a poisson|bursty:N|trace:FILE|closed:K]"
+         << " [-c fixed:US|exp:US|bimodal:US,US,P|lognormal:US,SIGMA] [-t threads,...] [-m maxThreads]"
+         << " [-q queueLen] [-T type,...] [-s seed]" << endl;
+}
+
+int main(int argc, char* argv[]){
+    LoadSpec spec;
+    int opt;
+    while((opt = getopt(argc, argv, "r:d:a:c:t:m:q:T:s:h")) != -1){
+        switch (opt)
+        {
+            case 'r': spec.rate = std::atof(optarg); break;
+            case 'd': spec.seconds = std::atof(optarg); break;
+            case 'a': spec.arrival = optarg; break;
+            case 'c': spec.cost = optarg; break;
+            case 't':
+                spec.threads.clear();
+                for(auto& t: split(optarg, ',')) spec.threads.push_back(std::atoi(t.c_str()));
+                break;
+            case 'm': spec.maxThreads = std::atoi(optarg); break;
+            case 'q': spec.queueLen = std::atoi(optarg); break;
+            case 'T':
+                spec.types.clear();
+                for(auto& t: split(optarg, ',')){
+                    bool found = false;
+                    for(int i = 0; i <= int(TaskQueueType::FAIR_WFQ); ++i){
+                        if(t == typeName(TaskQueueType(i))){
+                            spec.types.push_back(TaskQueueType(i));
+                            found = true;
+                        }
+                    }
+                    if(!found){
+                        cerr << "unknown queue type " << t << endl;
+                        return 1;
+                    }
+                }
+                break;
+            case 's': spec.seed = unsigned(std::atoi(optarg)); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    std::vector<Arrival> schedule;
+    try{
+        schedule = makeSchedule(spec);
+    }catch (std::exception& e){
+        cerr << e.what() << endl;
+        usage(argv[0]);
+        return 1;
+    }
+    if(schedule.empty()){
+        cerr << "empty schedule" << endl;
+        return 1;
+    }
+    std::vector<double> args;
+    std::string kind = parseSpec(spec.arrival, args);
+    int clients = kind == "closed" ? (args.empty() || args[0] < 1 ? 1 : int(args[0])) : 0;
+
+    double work = 0;
+    for(auto& a: schedule) work += a.cost;
+    double span = clients ? spec.seconds * 1e9 : double(schedule.back().at > 0 ? schedule.back().at : 1);
+    cout << "arrival " << spec.arrival << "  cost " << spec.cost << "  tasks " << schedule.size()
+         << "  offered " << std::fixed << std::setprecision(0) << schedule.size() * 1e9 / span << "/s"
+         << "  cpus " << std::thread::hardware_concurrency() << endl;
+
+    for(int threads: spec.threads){
+        for(TaskQueueType tt: spec.types){
+            Result r;
+            {
+                ThreadPool pool(threads, spec.maxThreads, spec.queueLen, 0, 0, InitType::HUNGER, tt);
+                pool.start();
+                if(clients){
+                    runClosed(pool, schedule, clients, spec.rate, r);
+                }else{
+                    runOpen(pool, schedule, r);
+                }
+                pool.shutdown();
+            }
+            cout << std::setprecision(1) << endl << typeName(tt) << "  threads " << threads;
+            if(spec.maxThreads > threads) cout << "-" << spec.maxThreads;
+            cout << "  utilization " << std::setprecision(2) << work / span / threads
+                 << "  rejected " << r.rejected.load() << "  max lag(us) " << r.maxLag / 1000.0 << endl;
+            cout << std::setprecision(1) << "  " << std::left << std::setw(8) << "us" << std::right;
+            for(const char* h: {"p50", "p90", "p99", "p99.9", "p99.99", "max", "mean"}){
+                cout << std::setw(11) << h;
+            }
+            cout << endl;
+            printRow("start", r.start);
+            printRow("finish", r.finish);
+            printRow("naive", r.naive);
+        }
+    }
+    return 0;
+}
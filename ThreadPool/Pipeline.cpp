@@ -0,0 +1,190 @@
+#include "Pipeline.h"
+
+#include <stdexcept>
+
+Pipeline::Pipeline(ThreadPool& _pool, int tokens)
+: pool(_pool), maxTokens(tokens < 1 ? 1 : tokens),
+  started(false), inputBusy(false), inputDone(false), finished(false), inputPosted(false), cancelled(false),
+  active(0), tasks(0), nextSeq(0), done(std::make_shared<std::promise<void>>())
+{
+
+}
+
+void Pipeline::addFilter(StageMode mode, std::function<void(std::any&)> fn){
+    std::lock_guard<std::mutex> lock(mtx);
+    if(started){
+        throw std::logic_error("Pipeline: add stage after run");
+    }
+    filters.push_back(std::make_unique<Filter>(mode, std::move(fn)));
+}
+
+void Pipeline::run(){
+    runAsync().get();
+}
+
+std::future<void> Pipeline::runAsync(){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(started){
+            throw std::logic_error("Pipeline: already started");
+        }
+        if(!input){
+            throw std::logic_error("Pipeline: no source");
+        }
+        started = true;
+        inputPosted = true;
+    }
+    std::future<void> res = done->get_future();
+    spawn([this](){ startInput(true); });
+    return res;
+}
+
+//所有访问this的任务都经过spawn计数，计数归零前run不会返回
+void Pipeline::spawn(CallBack&& task){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++tasks;
+    }
+    pool.post([this, task](){
+        task();
+        taskEnd();
+    });
+}
+
+void Pipeline::taskEnd(){
+    std::shared_ptr<std::promise<void>> res;
+    std::exception_ptr err;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(--tasks == 0 && inputDone && !finished){
+            finished = true;
+            res = done;
+            err = error;
+        }
+    }
+    //之后不能再访问成员，run的调用方可能已经析构Pipeline
+    if(!res) return;
+    if(err){
+        res->set_exception(err);
+    }else{
+        res->set_value();
+    }
+}
+
+void Pipeline::fail(std::exception_ptr e){
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!error) error = e;
+    cancelled = true;
+    inputDone = true;
+}
+
+//输入阶段串行执行，取到数据后在当前worker上接着执行后面的阶段，token走完后循环取下一个数据
+//posted表示由投递的取输入任务调用
+void Pipeline::startInput(bool posted){
+    while(true){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(posted){
+                inputPosted = false;
+                posted = false;
+            }
+            if(inputDone || inputBusy || active >= maxTokens) return;
+            inputBusy = true;
+            ++active;
+        }
+        TokenPtr token = std::make_shared<Token>();
+        token->stage = 0;
+        bool ok = false;
+        try{
+            ok = input(token->value);
+        }catch(...){
+            fail(std::current_exception());
+        }
+        bool more = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            inputBusy = false;
+            if(ok){
+                token->seq = nextSeq++;
+                //已有投递的取输入任务时不再投递，它开始执行后会按需再投递
+                more = !inputDone && active < maxTokens && !inputPosted;
+                if(more) inputPosted = true;
+            }else{
+                inputDone = true;
+                --active;
+            }
+        }
+        if(!ok) return;
+        //还有空闲token，让其他worker并行取下一个数据
+        if(more) spawn([this](){ startInput(true); });
+        //token挂起时由接手它的任务继续
+        if(!runToken(std::move(token), false)) return;
+    }
+}
+
+//从token->stage开始执行，owns表示已经持有该串行阶段
+//token走完所有阶段返回true，在串行阶段挂起返回false
+bool Pipeline::runToken(TokenPtr token, bool owns){
+    while(token->stage < filters.size()){
+        Filter& f = *filters[token->stage];
+        bool serial = f.mode != StageMode::PARALLEL;
+        if(serial && !owns && !enter(f, token)) return false;
+        owns = false;
+        //取消后不再执行阶段函数，但仍按顺序经过串行阶段，后面的token才能进入
+        if(!cancelled.load()){
+            try{
+                f.fn(token->value);
+            }catch(...){
+                fail(std::current_exception());
+            }
+        }
+        if(serial){
+            TokenPtr next = leave(f);
+            //token空出来后，接手的worker接着取下一个数据
+            if(next) spawn([this, next](){ if(runToken(next, true)) startInput(false); });
+        }
+        ++token->stage;
+    }
+    token.reset();
+    std::lock_guard<std::mutex> lock(mtx);
+    --active;
+    return true;
+}
+
+//能进入返回true，否则挂起token
+bool Pipeline::enter(Filter& f, const TokenPtr& token){
+    std::lock_guard<std::mutex> lock(f.mtx);
+    if(f.mode == StageMode::SERIAL_IN_ORDER){
+        if(!f.busy && token->seq == f.nextSeq){
+            f.busy = true;
+            return true;
+        }
+        f.ordered.emplace(token->seq, token);
+        return false;
+    }
+    if(!f.busy){
+        f.busy = true;
+        return true;
+    }
+    f.waiting.push_back(token);
+    return false;
+}
+
+//离开串行阶段，返回接手该阶段的token
+Pipeline::TokenPtr Pipeline::leave(Filter& f){
+    std::lock_guard<std::mutex> lock(f.mtx);
+    TokenPtr next;
+    if(f.mode == StageMode::SERIAL_IN_ORDER){
+        ++f.nextSeq;
+        auto it = f.ordered.find(f.nextSeq);
+        if(it != f.ordered.end()){
+            next = std::move(it->second);
+            f.ordered.erase(it);
+        }
+    }else if(!f.waiting.empty()){
+        next = std::move(f.waiting.front());
+        f.waiting.pop_front();
+    }
+    if(!next) f.busy = false;
+    return next;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <any>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <exception>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+//流水线阶段的并发方式
+enum class StageMode{
+    PARALLEL,               //任意多个token同时执行
+    SERIAL_IN_ORDER,        //一次一个，按输入顺序
+    SERIAL_OUT_OF_ORDER     //一次一个，先到先执行
+};
+
+template<typename T>
+class PipelineStage;
+
+/*
+    有界token流水线。输入阶段串行产生数据，每个数据是一个token，同时在流水线中的token不超过maxTokens，内存有上界。
+    token在一个worker上连续执行后面的阶段；串行阶段被占用时token挂起，不占用worker，
+    占用者离开时把阶段直接交给下一个可以进入的token并投递到线程池。token走完最后一个阶段后，
+    同一个worker在循环中接着从输入阶段取下一个数据，不递归；同一时刻最多有一个投递出去的取输入任务，
+    worker很少、队列很短时也不会填满队列。吞吐由最慢的串行阶段决定。
+
+    Pipeline pipe(pool, 16);
+    pipe.source([&]() -> std::optional<std::string> { ... })      // 返回nullopt表示输入结束
+        .then(StageMode::PARALLEL, parse)
+        .then(StageMode::SERIAL_IN_ORDER, [&](Record r){ ... });
+    pipe.run();
+
+    阶段之间的数据放在std::any中，类型需可拷贝构造。一个Pipeline只能运行一次，
+    run阻塞调用线程，不能在同一线程池的任务中调用；runAsync返回后Pipeline要保持有效直到future就绪。
+    阶段抛出异常后停止输入，已在流水线中的token不再执行阶段函数，异常由run/future抛出。
+*/
+class Pipeline{
+    private:
+        template<typename T>
+        friend class PipelineStage;
+
+        struct Token{
+            uint64_t seq;
+            size_t stage;
+            std::any value;
+        };
+        using TokenPtr = std::shared_ptr<Token>;
+
+        struct Filter{
+            StageMode mode;
+            std::function<void(std::any&)> fn;
+            std::mutex mtx;
+            bool busy;
+            uint64_t nextSeq;                       //SERIAL_IN_ORDER下一个可以进入的序号
+            std::map<uint64_t, TokenPtr> ordered;   //SERIAL_IN_ORDER挂起的token
+            std::deque<TokenPtr> waiting;           //SERIAL_OUT_OF_ORDER挂起的token
+
+            Filter(StageMode m, std::function<void(std::any&)> f)
+            : mode(m), fn(std::move(f)), busy(false), nextSeq(0) {}
+        };
+
+        ThreadPool& pool;
+        int maxTokens;
+        std::function<bool(std::any&)> input;
+        std::vector<std::unique_ptr<Filter>> filters;
+
+        std::mutex mtx;
+        bool started, inputBusy, inputDone, finished;
+        bool inputPosted;       //已投递还没开始执行的取输入任务，最多一个
+        std::atomic<bool> cancelled;
+        int active;             //已取得输入还没走完的token数
+        int tasks;              //已投递还没结束的任务数，归零且输入结束时流水线完成
+        uint64_t nextSeq;
+        std::exception_ptr error;
+        std::shared_ptr<std::promise<void>> done;
+
+        void addFilter(StageMode mode, std::function<void(std::any&)> fn);
+        void spawn(CallBack&& task);
+        void taskEnd();
+        void startInput(bool posted);
+        bool runToken(TokenPtr token, bool owns);
+        bool enter(Filter& f, const TokenPtr& token);
+        TokenPtr leave(Filter& f);
+        void fail(std::exception_ptr e);
+
+    public:
+        Pipeline(ThreadPool& _pool, int tokens);
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        //gen返回std::optional<T>，nullopt表示输入结束
+        template<typename F>
+        auto source(F gen) -> PipelineStage<typename std::invoke_result_t<F>::value_type>{
+            using T = typename std::invoke_result_t<F>::value_type;
+            input = [gen](std::any& v) mutable {
+                std::optional<T> item = gen();
+                if(!item) return false;
+                v = std::move(*item);
+                return true;
+            };
+            return PipelineStage<T>(this);
+        }
+
+        void run();
+        std::future<void> runAsync();
+};
+
+//流水线当前的末端，输出类型为T
+template<typename T>
+class PipelineStage{
+    private:
+        Pipeline* pipe;
+    public:
+        explicit PipelineStage(Pipeline* p): pipe(p) {}
+
+        //f接受T，返回值作为下一阶段的输入，返回void时为最后一个阶段
+        template<typename F>
+        auto then(StageMode mode, F f) -> PipelineStage<std::invoke_result_t<F, T>>{
+            static_assert(!std::is_void<T>::value, "previous stage produces no value");
+            using R = std::invoke_result_t<F, T>;
+            pipe->addFilter(mode, [f](std::any& v) mutable {
+                if constexpr (std::is_void<R>::value){
+                    f(std::any_cast<T>(std::move(v)));
+                    v.reset();
+                }else{
+                    v = f(std::any_cast<T>(std::move(v)));
+                }
+            });
+            return PipelineStage<R>(pipe);
+        }
+};
@@ -0,0 +1,105 @@
+#include "PoolThread.h"
+
+#include <system_error>
+#include <exception>
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+namespace{
+    struct StartArg{
+        ThreadInfo info;
+        std::function<void()> body;
+    };
+}
+
+void* PoolThread::run(void* arg){
+    StartArg* start = static_cast<StartArg*>(arg);
+    apply(start->info);
+    start->body();
+    delete start;
+    return nullptr;
+}
+
+void PoolThread::apply(const ThreadInfo& info){
+    if(!info.name.empty()){
+        pthread_setname_np(pthread_self(), info.name.substr(0, 15).c_str());
+    }
+    //新线程继承创建者的调度属性，创建者可能是其他通道的线程，未设置的字段要恢复成base
+    const ThreadAttr& attr = info.attr;
+    bool setPolicy = attr.policy != ThreadAttr::unset;
+    int policy = setPolicy ? attr.policy : info.base.policy;
+    int priority = setPolicy ? attr.priority : info.base.priority;
+    if(policy != ThreadAttr::unset){
+        int cur;
+        sched_param param;
+        pthread_getschedparam(pthread_self(), &cur, &param);
+        if(cur != policy || param.sched_priority != priority){
+            param.sched_priority = priority;
+            int err = pthread_setschedparam(pthread_self(), policy, &param);
+            if(err && setPolicy){
+                std::cerr << info.name << ": pthread_setschedparam: " << std::strerror(err) << std::endl;
+            }
+        }
+    }
+    //Linux下nice值是线程级的
+    bool setNice = attr.nice != ThreadAttr::unset;
+    int nice = setNice ? attr.nice : info.base.nice;
+    if(nice != ThreadAttr::unset){
+        id_t tid = id_t(syscall(SYS_gettid));
+        if(getpriority(PRIO_PROCESS, tid) != nice && setpriority(PRIO_PROCESS, tid, nice) != 0 && setNice){
+            std::cerr << info.name << ": setpriority: " << std::strerror(errno) << std::endl;
+        }
+    }
+}
+
+PoolThread::PoolThread(const ThreadInfo& info, std::function<void()> body)
+: running(false)
+{
+    pthread_attr_t pattr;
+    pthread_attr_init(&pattr);
+    if(info.attr.stackSize){
+        size_t stack = info.attr.stackSize < size_t(PTHREAD_STACK_MIN) ? size_t(PTHREAD_STACK_MIN) : info.attr.stackSize;
+        pthread_attr_setstacksize(&pattr, stack);
+    }
+    StartArg* start = new StartArg{info, std::move(body)};
+    int err = pthread_create(&th, &pattr, &PoolThread::run, start);
+    pthread_attr_destroy(&pattr);
+    if(err){
+        delete start;
+        throw std::system_error(err, std::generic_category(), "pthread_create");
+    }
+    running = true;
+}
+
+PoolThread::PoolThread(PoolThread&& other) noexcept
+: th(other.th), running(other.running)
+{
+    other.running = false;
+}
+
+PoolThread& PoolThread::operator=(PoolThread&& other) noexcept{
+    if(running) std::terminate();
+    th = other.th;
+    running = other.running;
+    other.running = false;
+    return *this;
+}
+
+PoolThread::~PoolThread(){
+    if(running) std::terminate();
+}
+
+void PoolThread::join(){
+    if(!running){
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "PoolThread::join");
+    }
+    int err = pthread_join(th, nullptr);
+    if(err){
+        throw std::system_error(err, std::generic_category(), "pthread_join");
+    }
+    running = false;
+}
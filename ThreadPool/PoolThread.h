@@ -0,0 +1,67 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <cstddef>
+#include <climits>
+#include <string>
+#include <functional>
+
+/*
+    线程池创建的线程。std::thread不能指定栈大小，这里直接用pthread，
+    线程启动后先设置名字、调度策略和nice值，再执行任务。
+*/
+
+//线程所在的通道，各通道可以设置不同的属性
+enum class ThreadLane{
+    WORKER,     //普通worker
+    URGENT,     //ComposeThreadPool中执行优先队列的0号worker
+    SPARE,      //补偿线程
+    SCALER      //动态调整线程
+};
+
+//policy和nice为unset时不修改，取ThreadInfo::base
+struct ThreadAttr{
+    static constexpr int unset = INT_MIN;
+    size_t stackSize = 0;           //0为系统默认(通常8MB)，小于PTHREAD_STACK_MIN时取PTHREAD_STACK_MIN
+    int policy = unset;             //SCHED_FIFO/SCHED_RR需要CAP_SYS_NICE
+    int priority = 0;               //policy的优先级，policy设置时才生效
+    int nice = unset;               //非实时策略的nice值，调低需要CAP_SYS_NICE
+};
+
+struct ThreadInfo{
+    ThreadLane lane;
+    int tid;                        //worker编号，补偿线程和动态调整线程为-1
+    std::string name;               //超过15字节的部分被截掉
+    ThreadAttr attr;
+    ThreadAttr base;                //未设置字段的取值，线程池start时记录调用线程的调度策略和nice值
+};
+
+class PoolThread{
+    private:
+        pthread_t th;
+        bool running;
+
+        static void* run(void* arg);
+    public:
+        PoolThread(): running(false) {}
+        //按info创建线程，创建失败抛std::system_error
+        PoolThread(const ThreadInfo& info, std::function<void()> body);
+        PoolThread(PoolThread&& other) noexcept;
+        PoolThread& operator=(PoolThread&& other) noexcept;
+        //同std::thread，析构时仍可join则terminate
+        ~PoolThread();
+
+        PoolThread(const PoolThread&) = delete;
+        PoolThread& operator=(const PoolThread&) = delete;
+
+        bool joinable() const {
+            return running;
+        }
+        void join();
+
+        //在当前线程上应用名字和调度属性，只改动与当前值不同的字段，显式设置的字段失败时打印警告
+        static void apply(const ThreadInfo& info);
+};
+
+//自定义线程创建，例如绑核、注册到监控；body必须在新线程中执行且只执行一次
+using ThreadFactory = std::function<PoolThread(const ThreadInfo& info, std::function<void()> body)>;
@@ -0,0 +1,488 @@
+#include "ProcessWorkers.h"
+
+#include <system_error>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <new>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+namespace{
+    const uint32_t padMark = 0xffffffffu;
+    const uint32_t resultOk = 0, resultError = 1;
+    const size_t lineLen = 64;
+
+    size_t alignUp(size_t n, size_t a){
+        return (n + a - 1) / a * a;
+    }
+
+    void notify(int fd){
+        uint64_t one = 1;
+        while(write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+
+    std::string describe(int index, int status){
+        std::string res = "worker process " + std::to_string(index);
+        if(WIFSIGNALED(status)){
+            res += " killed by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+        }else if(WIFEXITED(status)){
+            res += " exited with status " + std::to_string(WEXITSTATUS(status));
+        }
+        return res;
+    }
+}
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory ring needs lock-free 64-bit atomics");
+
+struct ProcessWorkers::RingHeader{
+    alignas(lineLen) std::atomic<uint64_t> head;    //生产者写
+    alignas(lineLen) std::atomic<uint64_t> tail;    //消费者写
+};
+
+struct ProcessWorkers::MsgHeader{
+    uint32_t len;           //负载字节数，padMark为填充
+    uint32_t tag;           //请求为handler编号，结果为resultOk/resultError
+    uint64_t id;
+};
+
+struct ProcessWorkers::WorkerState{
+    alignas(lineLen) std::atomic<uint64_t> current;     //正在执行的任务编号，0为空闲
+};
+
+bool ProcessWorkers::ShmRing::fits(size_t len) const {
+    return len < padMark && alignUp(sizeof(MsgHeader) + len, 8) <= cap;
+}
+
+bool ProcessWorkers::ShmRing::push(uint64_t id, uint32_t tag, const char* payload, size_t len){
+    size_t need = alignUp(sizeof(MsgHeader) + len, 8);
+    uint64_t head = hdr->head.load(std::memory_order_relaxed);
+    uint64_t tail = hdr->tail.load(std::memory_order_acquire);
+    size_t phys = size_t(head % cap);
+    size_t pad = cap - phys < need ? cap - phys : 0;
+    if(head - tail + pad + need > cap) return false;
+    if(pad >= sizeof(MsgHeader)){
+        reinterpret_cast<MsgHeader*>(data + phys)->len = padMark;
+    }
+    head += pad;
+    MsgHeader* msg = reinterpret_cast<MsgHeader*>(data + head % cap);
+    msg->len = uint32_t(len);
+    msg->tag = tag;
+    msg->id = id;
+    std::memcpy(msg + 1, payload, len);
+    hdr->head.store(head + need, std::memory_order_release);
+    return true;
+}
+
+bool ProcessWorkers::ShmRing::pop(uint64_t& id, uint32_t& tag, std::string& payload){
+    uint64_t next;
+    if(!peek(id, tag, payload, next)) return false;
+    commit(next);
+    return true;
+}
+
+bool ProcessWorkers::ShmRing::peek(uint64_t& id, uint32_t& tag, std::string& payload, uint64_t& next){
+    uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+    uint64_t head = hdr->head.load(std::memory_order_acquire);
+    while(tail < head){
+        size_t phys = size_t(tail % cap);
+        MsgHeader* msg = reinterpret_cast<MsgHeader*>(data + phys);
+        if(cap - phys < sizeof(MsgHeader) || msg->len == padMark){
+            tail += cap - phys;
+            continue;
+        }
+        id = msg->id;
+        tag = msg->tag;
+        payload.assign(reinterpret_cast<char*>(msg + 1), msg->len);
+        next = tail + alignUp(sizeof(MsgHeader) + msg->len, 8);
+        return true;
+    }
+    return false;
+}
+
+void ProcessWorkers::ShmRing::commit(uint64_t next){
+    hdr->tail.store(next, std::memory_order_release);
+}
+
+ProcessWorkers::ProcessWorkers(int n, std::unordered_map<uint32_t, ProcessHandler> handlerMap, const ProcessOptions& options)
+: handlers(std::move(handlerMap)), shm(nullptr), shmLen(0), stopFlag(nullptr), respFd(-1),
+  nextId(1), stopping(false), exited(false), restarts(0)
+{
+    if(n < 1) n = 1;
+    size_t ring = alignUp(options.ringBytes < 4096 ? 4096 : options.ringBytes, lineLen);
+    //控制块，之后每个worker依次是状态、请求环头、请求数据、结果环头、结果数据
+    size_t block = sizeof(WorkerState) + 2 * (sizeof(RingHeader) + ring);
+    shmLen = lineLen + n * block;
+
+    int memfd = memfd_create("threadpool-workers", MFD_CLOEXEC);
+    if(memfd < 0){
+        throw std::system_error(errno, std::generic_category(), "memfd_create");
+    }
+    if(ftruncate(memfd, off_t(shmLen)) != 0){
+        int err = errno;
+        close(memfd);
+        throw std::system_error(err, std::generic_category(), "ftruncate");
+    }
+    void* p = mmap(nullptr, shmLen, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    int err = errno;
+    //映射在fork后继承，不需要保留fd
+    close(memfd);
+    if(p == MAP_FAILED){
+        throw std::system_error(err, std::generic_category(), "mmap");
+    }
+    shm = static_cast<char*>(p);
+    stopFlag = new (shm) std::atomic<int>(0);
+
+    respFd = eventfd(0, EFD_CLOEXEC);
+    if(respFd < 0){
+        err = errno;
+        munmap(shm, shmLen);
+        throw std::system_error(err, std::generic_category(), "eventfd");
+    }
+    workers.resize(n);
+    char* cur = shm + lineLen;
+    for(int i = 0; i < n; ++i){
+        Worker& w = workers[i];
+        w.state = new (cur) WorkerState();
+        w.state->current.store(0);
+        cur += sizeof(WorkerState);
+        ShmRing* rings[2] = {&w.req, &w.resp};
+        for(ShmRing* r: rings){
+            r->hdr = new (cur) RingHeader();
+            r->hdr->head.store(0);
+            r->hdr->tail.store(0);
+            r->data = cur + sizeof(RingHeader);
+            r->cap = ring;
+            cur += sizeof(RingHeader) + ring;
+        }
+        w.pid = -1;
+        w.pidfd = -1;
+        w.inflight = 0;
+        w.alive = false;
+        w.reqFd = eventfd(0, EFD_CLOEXEC);
+    }
+    for(auto& w: workers){
+        if(w.reqFd < 0){
+            err = errno;
+            for(auto& c: workers){
+                if(c.reqFd >= 0) close(c.reqFd);
+            }
+            close(respFd);
+            munmap(shm, shmLen);
+            throw std::system_error(err, std::generic_category(), "eventfd");
+        }
+    }
+    //所有fork都在监督线程中进行：PR_SET_PDEATHSIG跟随的是fork所在的线程，监督线程在worker全部退出后才结束
+    std::promise<void> ready;
+    std::future<void> started = ready.get_future();
+    supervisor = std::thread([this, &ready](){
+        try{
+            for(size_t i = 0; i < workers.size(); ++i){
+                spawn(int(i));
+            }
+        }catch (...){
+            ready.set_exception(std::current_exception());
+            return;
+        }
+        ready.set_value();
+        supervise();
+    });
+    try{
+        started.get();
+    }catch (...){
+        supervisor.join();
+        //已创建的进程直接杀掉
+        for(auto& w: workers){
+            if(w.alive){
+                kill(w.pid, SIGKILL);
+                waitpid(w.pid, nullptr, 0);
+                close(w.pidfd);
+            }
+            close(w.reqFd);
+        }
+        close(respFd);
+        munmap(shm, shmLen);
+        throw;
+    }
+}
+
+ProcessWorkers::~ProcessWorkers(){
+    stop(true);
+    for(auto& w: workers){
+        close(w.reqFd);
+    }
+    close(respFd);
+    munmap(shm, shmLen);
+}
+
+//创建第i个worker进程，只在监督线程中调用
+void ProcessWorkers::spawn(int i){
+    Worker& w = workers[i];
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if(pid < 0){
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    if(pid == 0){
+        //父进程退出时worker跟着退出
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(getppid() != parent) _exit(1);
+        workerMain(i);
+    }
+    int pidfd = int(syscall(SYS_pidfd_open, pid, 0));
+    if(pidfd < 0){
+        int err = errno;
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        throw std::system_error(err, std::generic_category(), "pidfd_open");
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    w.pid = pid;
+    w.pidfd = pidfd;
+    w.alive = true;
+}
+
+//worker进程的主循环，单线程执行handler，结束时_exit，不执行父进程的析构和atexit
+void ProcessWorkers::workerMain(int i){
+    Worker& w = workers[i];
+    uint64_t id, next;
+    uint32_t tag;
+    std::string payload, result;
+    while(true){
+        //先记下正在执行的任务再移动尾部，两步之间被杀时任务仍在环中，重启后接着执行
+        if(w.req.peek(id, tag, payload, next)){
+            w.state->current.store(id);
+            w.req.commit(next);
+            uint32_t status = resultOk;
+            try{
+                auto it = handlers.find(tag);
+                if(it == handlers.end()){
+                    throw std::invalid_argument("unregistered process handler " + std::to_string(tag));
+                }
+                result = it->second(payload);
+            }catch (std::exception& e){
+                status = resultError;
+                result = e.what();
+            }catch (...){
+                status = resultError;
+                result = "unknown exception";
+            }
+            if(!w.resp.fits(result.size())){
+                status = resultError;
+                result = "result larger than ring";
+            }
+            //结果环满时等父进程取走
+            while(!w.resp.push(id, status, result.data(), result.size())){
+                notify(respFd);
+                usleep(100);
+            }
+            w.state->current.store(0);
+            notify(respFd);
+            continue;
+        }
+        if(stopFlag->load()) break;
+        uint64_t v;
+        while(read(w.reqFd, &v, sizeof(v)) < 0 && errno == EINTR) {}
+    }
+    _exit(0);
+}
+
+bool ProcessWorkers::submit(uint32_t handler, const std::string& payload, std::future<std::string>& res){
+    if(!handlers.count(handler)){
+        throw std::invalid_argument("unregistered process handler " + std::to_string(handler));
+    }
+    if(!workers[0].req.fits(payload.size())){
+        throw std::length_error("process task payload larger than ring");
+    }
+    int target = -1;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(stopping){
+            throw std::logic_error("process workers stopped");
+        }
+        //按未完成任务数从少到多尝试
+        std::vector<int> order(workers.size());
+        for(size_t i = 0; i < order.size(); ++i){
+            order[i] = int(i);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b){ return workers[a].inflight < workers[b].inflight; });
+        uint64_t id = nextId;
+        for(int i: order){
+            //重启失败的worker不再分配任务
+            if(!workers[i].alive) continue;
+            if(workers[i].req.push(id, handler, payload.data(), payload.size())){
+                target = i;
+                break;
+            }
+        }
+        if(target < 0) return false;
+        ++nextId;
+        Pending& p = pending[id];
+        p.worker = target;
+        res = p.promise.get_future();
+        ++workers[target].inflight;
+    }
+    notify(workers[target].reqFd);
+    return true;
+}
+
+//取走所有结果环中的结果，只在监督线程中调用
+void ProcessWorkers::collect(){
+    uint64_t id;
+    uint32_t tag;
+    std::string payload;
+    for(auto& w: workers){
+        while(w.resp.pop(id, tag, payload)){
+            std::promise<std::string> promise;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = pending.find(id);
+                if(it == pending.end()) continue;
+                promise = std::move(it->second.promise);
+                --workers[it->second.worker].inflight;
+                pending.erase(it);
+            }
+            if(tag == resultOk){
+                promise.set_value(std::move(payload));
+            }else{
+                promise.set_exception(std::make_exception_ptr(ProcessTaskException(payload)));
+            }
+        }
+    }
+}
+
+//回收退出的worker，让它正在执行的任务失败，没有停止时重启
+void ProcessWorkers::reap(int i){
+    Worker& w = workers[i];
+    int status = 0;
+    while(waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {}
+    close(w.pidfd);
+    //先取走崩溃前已经写出的结果
+    collect();
+    uint64_t id = w.state->current.exchange(0);
+    if(id){
+        //记下任务后、移动尾部前被杀，任务已按崩溃失败，从环中移除以免重启后再执行
+        uint64_t queued, next;
+        uint32_t tag;
+        std::string payload;
+        if(w.req.peek(queued, tag, payload, next) && queued == id) w.req.commit(next);
+    }
+    std::promise<std::string> promise;
+    bool crashed = false, restart;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        w.alive = false;
+        w.pidfd = -1;
+        auto it = id ? pending.find(id) : pending.end();
+        if(it != pending.end()){
+            promise = std::move(it->second.promise);
+            --w.inflight;
+            pending.erase(it);
+            crashed = true;
+        }
+        restart = !stopping;
+    }
+    if(crashed){
+        std::promise<std::string> failed = std::move(promise);
+        failed.set_exception(std::make_exception_ptr(ProcessCrashedException(describe(i, status))));
+    }
+    if(!restart) return;
+    restarts.fetch_add(1);
+    try{
+        spawn(i);
+    }catch (std::exception& e){
+        //请求环中的任务等不到执行，留到stop时失败
+        std::cerr << "restart worker process " << i << ": " << e.what() << std::endl;
+    }
+}
+
+void ProcessWorkers::supervise(){
+    std::vector<pollfd> fds;
+    std::vector<int> index;
+    while(true){
+        fds.assign(1, pollfd{respFd, POLLIN, 0});
+        index.clear();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(size_t i = 0; i < workers.size(); ++i){
+                if(workers[i].alive){
+                    fds.push_back(pollfd{workers[i].pidfd, POLLIN, 0});
+                    index.push_back(int(i));
+                }
+            }
+            if(index.empty() && stopping) break;
+        }
+        if(poll(fds.data(), fds.size(), -1) < 0){
+            if(errno == EINTR) continue;
+            std::cerr << "process supervisor poll: " << strerror(errno) << std::endl;
+            break;
+        }
+        if(fds[0].revents & POLLIN){
+            uint64_t v;
+            while(read(respFd, &v, sizeof(v)) < 0 && errno == EINTR) {}
+        }
+        collect();
+        for(size_t k = 0; k < index.size(); ++k){
+            if(fds[k + 1].revents){
+                reap(index[k]);
+            }
+        }
+    }
+    collect();
+    //没有worker再执行，剩下的任务失败
+    std::unordered_map<uint64_t, Pending> rest;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        rest.swap(pending);
+    }
+    for(auto& kv: rest){
+        kv.second.promise.set_exception(std::make_exception_ptr(ProcessCrashedException("process workers stopped before the task ran")));
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    exited = true;
+    cvOfExit.notify_all();
+}
+
+//通过pidfd发信号，进程已退出但还没被回收时pid不会被复用，调用方持有mtx且w.alive
+void ProcessWorkers::killWorker(Worker& w){
+    if(syscall(SYS_pidfd_send_signal, w.pidfd, SIGKILL, nullptr, 0) != 0 && errno == ENOSYS){
+        kill(w.pid, SIGKILL);
+    }
+}
+
+bool ProcessWorkers::stop(bool abort, std::chrono::steady_clock::time_point deadline){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(stopping && !supervisor.joinable()) return true;
+        stopping = true;
+        stopFlag->store(1);
+        for(auto& w: workers){
+            if(abort && w.alive) killWorker(w);
+            notify(w.reqFd);
+        }
+    }
+    notify(respFd);
+    bool inTime = true;
+    if(!abort && deadline != std::chrono::steady_clock::time_point::max()){
+        std::unique_lock<std::mutex> lock(mtx);
+        if(!cvOfExit.wait_until(lock, deadline, [this](){ return exited; })){
+            //正在执行的任务按崩溃失败，请求环中剩下的由监督线程失败
+            inTime = false;
+            for(auto& w: workers){
+                if(w.alive) killWorker(w);
+            }
+        }
+    }
+    if(supervisor.joinable()){
+        supervisor.join();
+    }
+    return inTime;
+}
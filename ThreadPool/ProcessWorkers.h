@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/types.h>
+
+//在worker进程中执行的任务，参数和返回值都是字节串
+using ProcessHandler = std::function<std::string(const std::string& payload)>;
+
+struct ProcessOptions{
+    size_t ringBytes = size_t(1) << 20;     //每个worker的请求环和结果环各自的字节数，单条消息不能超过它
+};
+
+//worker进程执行任务时崩溃，或停止时任务还没执行
+class ProcessCrashedException: public std::exception {
+    private:
+        std::string message;
+    public:
+        explicit ProcessCrashedException(const std::string& msg): message(msg) {}
+        const char* what() const noexcept override {
+            return message.c_str();
+        }
+};
+
+//handler在worker进程中抛出异常，what()为原异常的信息
+class ProcessTaskException: public std::exception {
+    private:
+        std::string message;
+    public:
+        explicit ProcessTaskException(const std::string& msg): message(msg) {}
+        const char* what() const noexcept override {
+            return message.c_str();
+        }
+};
+
+/*
+    多进程worker。共享内存(memfd)中每个worker有一对单生产者单消费者的环：请求环由父进程写、worker读，
+    结果环由worker写、父进程的监督线程读；环上的消息是任务编号、handler编号和负载，唤醒用eventfd。
+    每个环只有一个消费者，worker崩溃不会留下被占住一半的槽位：它正在执行的任务记录在共享状态中，
+    监督线程通过pidfd得知进程退出后让该任务的future失败，立即fork新进程接着消费同一个请求环。
+    父进程把任务分给未完成任务最少的worker。worker进程由父进程fork得到，handler在fork前注册；
+    监督线程重启worker时父进程已是多线程，handler不能依赖父进程其他线程持有的锁。
+*/
+class ProcessWorkers{
+    private:
+        struct RingHeader;
+        struct MsgHeader;
+        struct WorkerState;
+
+        //共享内存中的单生产者单消费者环，消息8字节对齐，不跨越末尾
+        struct ShmRing{
+            RingHeader* hdr;
+            char* data;
+            size_t cap;
+
+            bool push(uint64_t id, uint32_t tag, const char* payload, size_t len);
+            bool pop(uint64_t& id, uint32_t& tag, std::string& payload);
+            //读出下一条消息但不移动尾部，commit(next)后才把槽位还给生产者
+            bool peek(uint64_t& id, uint32_t& tag, std::string& payload, uint64_t& next);
+            void commit(uint64_t next);
+            bool fits(size_t len) const;
+        };
+
+        struct Worker{
+            pid_t pid;
+            int pidfd;
+            int reqFd;              //请求eventfd，父进程写，worker等待
+            ShmRing req, resp;
+            WorkerState* state;
+            int inflight;           //已分配还没完成的任务数
+            bool alive;
+        };
+        struct Pending{
+            int worker;
+            std::promise<std::string> promise;
+        };
+
+        std::unordered_map<uint32_t, ProcessHandler> handlers;
+        char* shm;
+        size_t shmLen;
+        std::atomic<int>* stopFlag;     //在共享内存中，worker取空请求环后看到它就退出
+        std::vector<Worker> workers;
+        int respFd;                     //结果eventfd，worker写，监督线程等待
+
+        std::mutex mtx;
+        std::unordered_map<uint64_t, Pending> pending;
+        uint64_t nextId;
+        bool stopping;
+        bool exited;                    //监督线程已让剩余任务失败，stop在cvOfExit上等它
+        std::condition_variable cvOfExit;
+        std::atomic<long long> restarts;
+        std::thread supervisor;
+
+        void spawn(int i);
+        [[noreturn]] void workerMain(int i);
+        void supervise();
+        void collect();
+        void reap(int i);
+        void killWorker(Worker& w);
+
+    public:
+        //fork n个worker进程，失败抛std::system_error
+        ProcessWorkers(int n, std::unordered_map<uint32_t, ProcessHandler> handlerMap, const ProcessOptions& options);
+        ~ProcessWorkers();
+
+        ProcessWorkers(const ProcessWorkers&) = delete;
+        ProcessWorkers& operator=(const ProcessWorkers&) = delete;
+
+        //所有请求环都满时返回false；handler未注册抛std::invalid_argument，消息超过环大小抛std::length_error
+        bool submit(uint32_t handler, const std::string& payload, std::future<std::string>& res);
+        //不再接受任务，abort为false时等worker执行完已分配的任务，为true时直接杀掉worker，剩余任务的future失败
+        //超过deadline还没执行完时按abort处理并返回false
+        bool stop(bool abort, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+        long long getRestarts(){
+            return restarts.load();
+        }
+};
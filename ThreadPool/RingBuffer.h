@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+//基于std::atomic_flag的自旋锁，满足BasicLockable
+class SpinLock{
+    private:
+        std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    public:
+        void lock(){
+            while(flag.test_and_set(std::memory_order_acquire)) {}
+        }
+        void unlock(){
+            flag.clear(std::memory_order_release);
+        }
+};
+
+/*
+    有界环形缓冲区，头尾各一把锁，生产者之间、消费者之间互斥，生产者和消费者只通过len同步。
+    Lock为std::mutex时即BlockRingBuffer，为SpinLock时即LockFreeRingBuffer。
+    T需要可默认构造，出队后槽位重置为T()，不再持有对象。push失败时不移动参数。
+*/
+template<typename T, typename Lock>
+class RingBuffer{
+    private:
+        std::vector<T> buf;
+        int startInd, nextInd, cap;
+        std::atomic<int> len;
+        Lock startLock, nextLock;
+
+        template<typename U>
+        bool put(U&& item){
+            std::lock_guard<Lock> lock(nextLock);
+            //持锁检查，len只会被消费者减小
+            if(len.load() >= cap) return false;
+            buf[nextInd++] = std::forward<U>(item);
+            if(nextInd == cap){
+                nextInd = 0;
+            }
+            len.fetch_add(1);
+            return true;
+        }
+
+    public:
+        explicit RingBuffer(int capacity)
+        : buf(capacity < 1 ? 1 : capacity), startInd(0), nextInd(0), cap(capacity < 1 ? 1 : capacity), len(0) {}
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        bool push(const T& item){
+            return put(item);
+        }
+        bool push(T&& item){
+            return put(std::move(item));
+        }
+        bool pop(T& item){
+            if(len.load() == 0) return false;
+            std::lock_guard<Lock> lock(startLock);
+            if(len.load() == 0) return false;
+            item = std::move(buf[startInd]);
+            buf[startInd++] = T();
+            if(startInd == cap){
+                startInd = 0;
+            }
+            len.fetch_sub(1);
+            return true;
+        }
+
+        bool empty() const {
+            return len.load() == 0;
+        }
+        bool full() const {
+            return len.load() >= cap;
+        }
+        int size() const {
+            return len.load();
+        }
+        int capacity() const {
+            return cap;
+        }
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <future>
+#include <functional>
+#include <thread>
+#include <iostream>
+
+#include "ThreadPool.h"
+
+/*
+    串行执行器，同一个Strand上提交的任务按提交顺序执行，且不会并发。
+    提交者之间用侵入式无锁MPSC队列，外加一个scheduled标志：只有把标志从false置为true的提交者
+    才把排空任务投递到线程池，Strand没有任务时不占用worker。
+    每次最多连续执行batch个任务，然后重新投递，避免长队列独占worker。
+*/
+class Strand{
+    private:
+        struct Node{
+            std::atomic<Node*> next;
+            CallBack task;
+            Node(): next(nullptr) {}
+        };
+
+        struct Impl{
+            ThreadPool& pool;
+            std::atomic<Node*> tail;
+            Node* head;     //只有持有scheduled的排空者访问
+            std::atomic<bool> scheduled;
+            int batch;
+
+            Impl(ThreadPool& p, int b)
+            : pool(p), tail(new Node()), head(nullptr), scheduled(false), batch(b) {
+                head = tail.load();
+            }
+            ~Impl(){
+                while(head){
+                    Node* next = head->next.load();
+                    delete head;
+                    head = next;
+                }
+            }
+
+            void push(Node* n){
+                Node* prev = tail.exchange(n);
+                prev->next.store(n, std::memory_order_release);
+            }
+            //head是哑结点，取出它的后继的任务，后继成为新的哑结点
+            bool pop(CallBack& task){
+                Node* next = head->next.load(std::memory_order_acquire);
+                if(!next) return false;
+                task = std::move(next->task);
+                delete head;
+                head = next;
+                return true;
+            }
+        };
+        std::shared_ptr<Impl> impl;
+
+        static void schedule(const std::shared_ptr<Impl>& s){
+            std::shared_ptr<Impl> self = s;
+            s->pool.post([self](){ drain(self); });
+        }
+
+        static void drain(const std::shared_ptr<Impl>& s){
+            int n = 0;
+            CallBack task;
+            while(true){
+                if(s->pop(task)){
+                    task();
+                    task = nullptr;
+                    if(++n >= s->batch){
+                        schedule(s);
+                        return;
+                    }
+                    continue;
+                }
+                //提交者已交换tail但还没链上next，等它完成
+                if(s->tail.load() != s->head){
+                    std::this_thread::yield();
+                    continue;
+                }
+                s->scheduled.store(false);
+                if(s->tail.load() == s->head) return;
+                //释放标志后又有提交，且提交者没有抢到标志
+                if(s->scheduled.exchange(true)) return;
+            }
+        }
+
+        void post(CallBack&& task){
+            Node* n = new Node();
+            n->task = std::move(task);
+            impl->push(n);
+            if(!impl->scheduled.exchange(true)){
+                schedule(impl);
+            }
+        }
+    public:
+        explicit Strand(ThreadPool& pool, int batch = 64)
+        : impl(std::make_shared<Impl>(pool, batch < 1 ? 1 : batch)) {}
+
+        //Strand析构后已提交的任务仍会执行完
+        ~Strand() {}
+
+        Strand(const Strand&) = delete;
+        Strand& operator=(const Strand&) = delete;
+
+        template<typename F, typename... Args>
+        auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))>{
+            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+
+            auto taskPtr = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+
+            post([taskPtr](){
+                try{
+                    (*taskPtr)();
+                }catch (std::exception& e){
+                    //LOG e.what()
+                    std::cerr << e.what() << std::endl;
+                }
+            });
+            return taskPtr->get_future();
+        }
+};
+
+using SerialExecutor = Strand;
@@ -24,56 +24,12 @@ bool BlockQueue::dequeue(CallBack& task){
     LG lock(mtx);
     if(taskQueue.empty()) return false;
 
-    task = taskQueue.front();
+    task = std::move(taskQueue.front());
     taskQueue.pop();
     return true;
 }
 
 
-/*
-    有锁环形缓冲区，头尾两个互斥量以及必要的原子变量
-*/
-
-bool BlockRingBuffer::enqueue(CallBack& task){
-    if(int(len.load()) == capacity) return false;
-    LG lock(nextMtx);
-
-    taskQueue[nextInd++] = task;
-    if(nextInd == capacity){
-        nextInd = 0;
-    }
-    len.fetch_add(1);
-    return true;
-}
-
-
-bool BlockRingBuffer::enqueue(CallBack&& task){
-    if(int(len.load()) == capacity) return false;
-    LG lock(nextMtx);
-
-    taskQueue[nextInd++] = std::move(task);
-    if(nextInd == capacity){
-        nextInd = 0;
-    }
-    len.fetch_add(1);
-    return true;
-}
-
-
-bool BlockRingBuffer::dequeue(CallBack& task){
-    // std::cout << "want dequeue one" << std::endl;
-    if(int(len.load()) == 0) return false;
-    LG lock(startMtx);
-
-    task = taskQueue[startInd++];
-    if(startInd == capacity){
-        startInd = 0;
-    }
-    len.fetch_sub(1);
-    return true;
-}
-
-
 /*
     无锁队列，基于std::atomic_flag自旋锁
 */
@@ -109,7 +65,7 @@ bool LockFreeQueue::dequeue(CallBack& task){
     while(flag.test_and_set(std::memory_order_acquire)) {}
     res = !taskQueue.empty();
     if(res){
-        task = taskQueue.front();
+        task = std::move(taskQueue.front());
         taskQueue.pop();
     }
     flag.clear(std::memory_order_release);
@@ -139,61 +95,147 @@ int LockFreeQueue::size(){
 
 
 /*
-    无锁环形缓冲区，头尾各设置一个flag
+    多租户公平队列
 */
 
-bool LockFreeRingBuffer::enqueue(CallBack& task){
-    bool res = false;
-
-    while(nextFlag.test_and_set(std::memory_order_acquire)) {}
-    res = len.load() < capacity;
-    if(res){
-        taskQueue[nextInd++] = task;
-        if(nextInd == capacity){
-            nextInd = 0;
-        }
-        len.fetch_add(1);
+FairQueue::Flow& FairQueue::flow(int tenant){
+    auto it = flows.find(tenant);
+    if(it == flows.end()){
+        it = flows.emplace(tenant, Flow{{}, 1, maxLen, defaultOnFull, false, 0, vtime}).first;
     }
-    nextFlag.clear(std::memory_order_release);
+    return it->second;
+}
 
-    return res;
+//子队列清空后重置状态，未单独配置的租户直接回收
+void FairQueue::release(int tenant, Flow& f){
+    f.deficit = 0;
+    if(!f.configured){
+        flows.erase(tenant);
+    }
 }
 
-bool LockFreeRingBuffer::enqueue(CallBack&& task){
-    bool res = false;
+bool FairQueue::enqueue(CallBack& task){
+    return enqueue(0, CallBack(task));
+}
+bool FairQueue::enqueue(CallBack&& task){
+    return enqueue(0, std::move(task));
+}
+bool FairQueue::enqueue(int tenant, CallBack&& task){
+    LG lock(mtx);
+    if(len.load() >= maxLen) return false;
+
+    Flow& f = flow(tenant);
+    int backlog = int(f.tasks.size());
+    bool full = backlog >= f.maxLen;
+    //预留区内按权重分份额，另算一份给新来的租户，超过份额的租户不能再占用
+    if(!full && len.load() >= maxLen - maxLen / 8){
+        int others = busyWeight - (backlog ? f.weight : 0);
+        full = (long long)backlog * (others + f.weight + 1) >= (long long)maxLen * f.weight;
+    }
+    if(full){
+        if(f.tasks.empty()) release(tenant, f);
+        return false;
+    }
 
-    while(nextFlag.test_and_set(std::memory_order_acquire)) {}
-    res = len.load() < capacity;
-    if(res){
-        taskQueue[nextInd++] = std::move(task);
-        if(nextInd == capacity){
-            nextInd = 0;
-        }
-        len.fetch_add(1);
+    double tag = 0;
+    if(mode == FairMode::WFQ){
+        tag = (vtime > f.lastFinish ? vtime : f.lastFinish) + 1.0 / f.weight;
+        f.lastFinish = tag;
+        if(f.tasks.empty()) heads.emplace(tag, tenant);
+    }else if(f.tasks.empty()){
+        active.push_back(tenant);
     }
-    nextFlag.clear(std::memory_order_release);
+    if(f.tasks.empty()) busyWeight += f.weight;
+    f.tasks.emplace(tag, std::move(task));
+    len.fetch_add(1);
+    return true;
+}
 
-    return res;
+bool FairQueue::dequeue(CallBack& task){
+    int tenant;
+    return dequeue(tenant, task);
 }
+bool FairQueue::dequeue(int& tenant, CallBack& task){
+    LG lock(mtx);
+    if(len.load() == 0) return false;
+
+    if(mode == FairMode::WFQ){
+        tenant = heads.begin()->second;
+        vtime = heads.begin()->first;
+        heads.erase(heads.begin());
+    }else{
+        tenant = active.front();
+    }
 
-bool LockFreeRingBuffer::dequeue(CallBack& task){
-    bool res = false;
+    Flow& f = flows[tenant];
+    task = std::move(f.tasks.front().second);
+    f.tasks.pop();
+    len.fetch_sub(1);
+    if(f.tasks.empty()) busyWeight -= f.weight;
 
-    while(startFlag.test_and_set(std::memory_order_acquire)) {}
-    res = len.load() > 0;
-    if(res){
-        task = taskQueue[startInd++];
-        if(startInd == capacity){
-            startInd = 0;
+    if(mode == FairMode::WFQ){
+        if(!f.tasks.empty()){
+            heads.emplace(f.tasks.front().first, tenant);
+        }else{
+            release(tenant, f);
         }
-        len.fetch_sub(1);
+        return true;
     }
-    startFlag.clear(std::memory_order_release);
 
-    return res;
+    //DRR：每轮补充weight个任务的额度，用完或队空后轮到下一个租户
+    if(f.deficit <= 0) f.deficit += f.weight;
+    --f.deficit;
+    if(f.tasks.empty()){
+        active.pop_front();
+        release(tenant, f);
+    }else if(f.deficit <= 0){
+        active.pop_front();
+        active.push_back(tenant);
+    }
+    return true;
 }
 
+void FairQueue::setTenant(int tenant, int weight, int maxTask){
+    setTenant(tenant, weight, maxTask, defaultOnFull);
+}
+void FairQueue::setTenant(int tenant, int weight, int maxTask, FullOperate fo){
+    LG lock(mtx);
+    Flow& f = flow(tenant);
+    if(!f.tasks.empty()) busyWeight -= f.weight;
+    f.weight = weight < 1 ? 1 : weight;
+    if(!f.tasks.empty()) busyWeight += f.weight;
+    f.maxLen = maxTask > 0 ? maxTask : maxLen;
+    f.onFull = fo;
+    f.configured = true;
+}
 
+FullOperate FairQueue::fullOperate(int tenant){
+    LG lock(mtx);
+    auto it = flows.find(tenant);
+    return it == flows.end() ? defaultOnFull : it->second.onFull;
+}
 
+int FairQueue::size(int tenant){
+    LG lock(mtx);
+    auto it = flows.find(tenant);
+    return it == flows.end() ? 0 : int(it->second.tasks.size());
+}
 
-
+void FairQueue::copyTenants(FairQueue& from){
+    struct Config{
+        int tenant, weight, maxTask;
+        FullOperate onFull;
+    };
+    std::vector<Config> configs;
+    {
+        LG lock(from.mtx);
+        for(auto& p: from.flows){
+            const Flow& f = p.second;
+            if(!f.configured) continue;
+            configs.push_back({p.first, f.weight, f.maxLen == from.maxLen ? 0 : f.maxLen, f.onFull});
+        }
+    }
+    for(auto& c: configs){
+        setTenant(c.tenant, c.weight, c.maxTask, c.onFull);
+    }
+}
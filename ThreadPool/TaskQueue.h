@@ -7,11 +7,27 @@
 #include <string>
 #include <functional>
 #include <queue>
+#include <deque>
+#include <set>
+#include <unordered_map>
 
 #include <iostream>
 
+#include "RingBuffer.h"
+
 using CallBack = std::function<void()>;
 
+//任务队列满后的操作
+enum class FullOperate{
+    REJECT,
+    EXCEPTION
+};
+//多租户公平队列的调度方式
+enum class FairMode{
+    DRR,    //加权差额轮询
+    WFQ     //加权公平排队(自计时虚拟时间)
+};
+
 class TaskQueue{
     public:
         TaskQueue() {}
@@ -62,27 +78,28 @@ class BlockQueue: public TaskQueue{
 */
 class BlockRingBuffer: public TaskQueue{
     private:
-        using LG = std::lock_guard<std::mutex>;
-        std::vector<CallBack> taskQueue;
-        int startInd, nextInd, capacity;
-        std::atomic<int> len;
-        std::mutex startMtx, nextMtx;
-
+        RingBuffer<CallBack, std::mutex> ring;
     
     public:
         BlockRingBuffer(int maxTask)
-        : taskQueue(maxTask), capacity(maxTask), startInd(0), nextInd(0), len(0){}
+        : ring(maxTask) {}
         ~BlockRingBuffer(){}
         
-        bool enqueue(CallBack& task) override;
-        bool enqueue(CallBack&& task) override;
-        bool dequeue(CallBack& task) override;
+        bool enqueue(CallBack& task) override{
+            return ring.push(task);
+        }
+        bool enqueue(CallBack&& task) override{
+            return ring.push(std::move(task));
+        }
+        bool dequeue(CallBack& task) override{
+            return ring.pop(task);
+        }
 
         bool empty() override{
-            return int(len.load()) == 0;
+            return ring.empty();
         }
         int size() override{
-            return int(len.load());
+            return ring.size();
         }
 };
 
@@ -115,27 +132,89 @@ class LockFreeQueue: public TaskQueue{
 */
 class LockFreeRingBuffer: public TaskQueue{
     private:
-        std::vector<CallBack> taskQueue;
-        std::atomic_flag startFlag, nextFlag;
-        int startInd, nextInd, capacity;
-        std::atomic<int> len;
+        RingBuffer<CallBack, SpinLock> ring;
     
     public:
         LockFreeRingBuffer(int maxTask)
-        : startInd(0), nextInd(0), capacity(maxTask), taskQueue(maxTask), len(0) {}
+        : ring(maxTask) {}
 
         ~LockFreeRingBuffer() {}
         
+        bool enqueue(CallBack& task) override{
+            return ring.push(task);
+        }
+        bool enqueue(CallBack&& task) override{
+            return ring.push(std::move(task));
+        }
+        bool dequeue(CallBack& task) override{
+            return ring.pop(task);
+        }
+
+        bool empty() override{
+            return ring.empty();
+        };
+        int size() override{
+            return ring.size();
+        };
+};
+
+/*
+    多租户公平队列，每个租户一个子队列，按权重DRR或WFQ出队，一把互斥锁。
+    未配置的租户权重为1，长度上限和队满操作取默认值，子队列为空时回收。
+    总长度的最后1/8只接纳积压未超过按权重份额的租户，一个租户灌满队列时其他租户仍能进入。
+    不带租户的enqueue进入0号租户。
+*/
+class FairQueue: public TaskQueue{
+    private:
+        using LG = std::lock_guard<std::mutex>;
+        struct Flow{
+            std::queue<std::pair<double, CallBack>> tasks;
+            int weight, maxLen;
+            FullOperate onFull;
+            bool configured;
+            int deficit;
+            double lastFinish;
+        };
+        std::unordered_map<int, Flow> flows;
+        std::deque<int> active;                 //DRR轮转顺序
+        std::set<std::pair<double, int>> heads; //WFQ各租户队头的完成标签
+        FairMode mode;
+        int maxLen;
+        FullOperate defaultOnFull;
+        double vtime;
+        int busyWeight;                         //子队列非空的租户权重之和
+        std::atomic<int> len;
+
+        std::mutex mtx;
+
+        Flow& flow(int tenant);
+        void release(int tenant, Flow& f);
+    
+    public:
+        FairQueue(int maxTask, FairMode m = FairMode::DRR, FullOperate fo = FullOperate::REJECT)
+        : mode(m), maxLen(maxTask), defaultOnFull(fo), vtime(0), busyWeight(0), len(0) {}
+        ~FairQueue(){}
+
         bool enqueue(CallBack& task) override;
         bool enqueue(CallBack&& task) override;
+        bool enqueue(int tenant, CallBack&& task);
         bool dequeue(CallBack& task) override;
+        bool dequeue(int& tenant, CallBack& task);
+
+        //weight至少为1，maxTask为0时不单独限制该租户
+        void setTenant(int tenant, int weight, int maxTask = 0);
+        void setTenant(int tenant, int weight, int maxTask, FullOperate fo);
+        FullOperate fullOperate(int tenant);
+        int size(int tenant);
+        //复制from中单独配置过的租户，未单独限制长度的租户沿用本队列的总长度
+        void copyTenants(FairQueue& from);
 
         bool empty() override{
             return len.load() == 0;
-        };
+        }
         int size() override{
-            return int(len.load());
-        };
+            return len.load();
+        }
 };
 
 class TaskQueueFullException: public std::exception {
@@ -1,20 +1,63 @@
 #include "ThreadPool.h"
 
-ThreadPool::ThreadWork::ThreadWork(ThreadPool* _pool, int id): pool(_pool), tid(id) {}
+#include <sys/resource.h>
+
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local int ThreadPool::currentTid = -1;
+thread_local const CancellationToken* ThreadPool::runningToken = nullptr;
+
+ThreadPool::ThreadWork::ThreadWork(ThreadPool* _pool, int id, Spare* sp, int n): pool(_pool), tid(id), spare(sp), prespawn(n) {}
 
 void ThreadPool::ThreadWork::operator()(){
+    if(prespawn > 0){
+        pool->prespawn(tid, prespawn);
+    }
+    currentPool = pool;
+    currentTid = spare ? -1 : tid;
+    WorkerSlot* slot = (!spare && tid < pool->slotCount) ? &pool->slots[tid] : nullptr;
+    int localRuns = 0, sharedRuns = 0;
     CallBack func;
     bool dequeued = false;
     while(!pool->isShutDown.load()){
-        //释放
-        if(pool->freeId == tid) break;
+        //先执行自己提交到本地槽位的任务，保持缓存热度
+        if(slot && localRuns < localBudget && slot->take(func)){
+            ++localRuns;
+            func();
+            func = nullptr;
+            pool->taskDone();
+            continue;
+        }
+        localRuns = 0;
+        //补偿线程：阻塞的worker已返回，退回空闲，超时未被再次激活则退出
+        if(spare && pool->retireSpare()){
+            if(!pool->parkSpare()) break;
+            continue;
+        }
+        if(sharedRuns >= stealInterval){
+            sharedRuns = 0;
+            if(pool->stealTask(tid, func)){
+                func();
+                func = nullptr;
+                pool->taskDone();
+                continue;
+            }
+        }
+        //溢出队列中是队列满时worker投递的内部任务，先执行
+        if(pool->overflowLen.load() > 0 && pool->takeOverflow(func)){
+            func();
+            func = nullptr;
+            pool->taskDone();
+            continue;
+        }
         
         //线程0优先执行urgTaskQueuePtr
-        if(tid == 0 && pool->threadPoolType == TheadPoolType::COMPOSITE){
+        if(!spare && tid == 0 && pool->threadPoolType == TheadPoolType::COMPOSITE){
             while(!pool->urgTaskQueuePtr->empty()){
                 dequeued = pool->urgTaskQueuePtr->dequeue(func);
                 if(dequeued){
                     func();
+                    func = nullptr;
+                    pool->taskDone();
                 }
             }
         }
@@ -22,96 +65,499 @@ void ThreadPool::ThreadWork::operator()(){
         {
             // std::cout << "2" << std::endl;
             std::unique_lock<std::mutex> lock(pool->mtxOfTaskQueuePtr);
-            if(pool->taskQueuePtr->empty()){
+            //持锁检查，shutdown和dynamicScale持锁修改，避免错过notify
+            if(pool->isShutDown.load() || (!spare && pool->freeId == tid)) break;
+            //持锁期间reconfigure不会替换队列
+            if(pool->queueGen.load()->queue->empty()){
+                //共享队列为空，先取自己的槽位，再从其他worker的槽位偷
+                if(pool->stealTask(tid, func)){
+                    lock.unlock();
+                    func();
+                    func = nullptr;
+                    pool->taskDone();
+                    continue;
+                }
+                if(pool->overflowLen.load() > 0) continue;
+                //补偿线程不计入阻塞数，超时等待以便及时退役
+                if(spare){
+                    pool->cvOfTaskQueuePtr.wait_for(lock, std::chrono::milliseconds(10));
+                    continue;
+                }
                 pool->blockedThreads.fetch_add(1);
                 if(tid != 0){
                     pool->cvOfTaskQueuePtr.wait(lock);
                 }
                 else{
                     if(pool->cvOfTaskQueuePtr.wait_for(lock, std::chrono::milliseconds(100)) == std::cv_status::timeout){
+                        pool->blockedThreads.fetch_sub(1);
                         continue;
                     }
                 }
                 pool->blockedThreads.fetch_sub(1);
             }
             // std::cout << "3" << std::endl;
-            dequeued = pool->taskQueuePtr->dequeue(func);
+            dequeued = pool->queueGen.load()->queue->dequeue(func);
         }
 
         if(dequeued){
             // std::cout << "run one" << std::endl;
+            ++sharedRuns;
             func();
+            func = nullptr;
+            pool->taskDone();
         }
         // std::cout << pool->isShutDown.load() << std::endl;
     }
+    //退出(被dynamicScale回收或shutdown)时把槽位里的任务交还共享队列
+    if(slot && slot->take(func)){
+        pool->pushShared(std::move(func));
+    }
+    if(spare){
+        pool->liveSpares.fetch_sub(1);
+        spare->done.store(true);
+    }
+}
+
+void ThreadPool::WorkerSlot::exchange(CallBack& task){
+    while(flag.test_and_set(std::memory_order_acquire)) {}
+    std::swap(this->task, task);
+    full.store(true, std::memory_order_release);
+    flag.clear(std::memory_order_release);
+}
+
+bool ThreadPool::WorkerSlot::take(CallBack& task){
+    if(!full.load(std::memory_order_acquire)) return false;
+    bool res = false;
+    while(flag.test_and_set(std::memory_order_acquire)) {}
+    if(full.load(std::memory_order_relaxed)){
+        task = std::move(this->task);
+        this->task = nullptr;
+        full.store(false, std::memory_order_relaxed);
+        res = true;
+    }
+    flag.clear(std::memory_order_release);
+    return res;
 }
 
 inline int max(int a, int b){
     return a > b ? a : b;
 }
 
+//登记后再确认仍是当前一代，与reconfigure的替换、计数检查构成Dekker式握手
+ThreadPool::QueueRef::QueueRef(ThreadPool& pool){
+    while(true){
+        gen = pool.queueGen.load();
+        gen->users.fetch_add(1);
+        if(pool.queueGen.load() == gen) break;
+        gen->users.fetch_sub(1);
+    }
+}
+
 ThreadPool::ThreadPool(int minThreads, int maxThreads, int maxQueueLen, int busyThreshold,
  int freeThreshold, InitType it, TaskQueueType tt, FullOperate fo)
-:size(0), minSize(minThreads), maxSize(maxThreads), busyThred(busyThreshold), 
-freeThred(freeThreshold), initType(it), tqType(tt), fullOperate(fo),
- isShutDown(true), blockedThreads(0), freeId(-1), threads(), taskQueuePtr(nullptr), urgTaskQueuePtr(nullptr) 
+:queueGen(nullptr), urgTaskQueuePtr(nullptr), threads(), isShutDown(true), blockedThreads(0),
+ size(0), minSize(minThreads), maxSize(maxThreads), busyThred(busyThreshold), freeThred(freeThreshold),
+ freeId(-1), queueLen(maxQueueLen), pendingTasks(0),
+ blockingThreads(0), activeSpares(0), liveSpares(0), idleSpares(0), spareTickets(0),
+ slots(nullptr), slotCount(0), reactor(nullptr), reactorPtr(nullptr), ioBackend(IoBackend::AUTO),
+ expiredTasks(0), cancelledTasks(0), rejectedTasks(0), threadName("pool"), spawnPending(0), spawnError(nullptr),
+ initType(it), tqType(tt), fullOperate(fo)
 {
     minSize = max(1, minSize);
 
+    //动态调整时worker编号最大到maxSize-1
+    slotCount = max(minSize, maxSize);
+    slots.reset(new WorkerSlot[slotCount]);
+
     threads.reserve(maxThreads);
     
     threadPoolType = TheadPoolType::PLAIN;
 
-    switch (tqType)
+    queueGen.store(makeQueue(tqType, maxQueueLen));
+    setThreshold(busyThreshold, freeThreshold);
+}
+
+ThreadPool::QueueGen* ThreadPool::makeQueue(TaskQueueType tt, int maxQueueLen){
+    QueueGen* gen = new QueueGen();
+    queueGens.emplace_back(gen);
+    gen->fair = nullptr;
+    switch (tt)
     {
         case TaskQueueType::BLOCK_QUEUE:
-            taskQueuePtr.reset(new BlockQueue(maxQueueLen));
+            gen->queue.reset(new BlockQueue(maxQueueLen));
             break;
         case TaskQueueType::BLOCK_RINGBUFFER:
-            taskQueuePtr.reset(new BlockRingBuffer(maxQueueLen));
+            gen->queue.reset(new BlockRingBuffer(maxQueueLen));
             break;
         case TaskQueueType::LOCKFREE_QUEUE:
-            taskQueuePtr.reset(new LockFreeQueue(maxQueueLen));
+            gen->queue.reset(new LockFreeQueue(maxQueueLen));
             break;
         case TaskQueueType::LOCKFREE_RINGBUFFER:
-            taskQueuePtr.reset(new LockFreeRingBuffer(maxQueueLen));
+            gen->queue.reset(new LockFreeRingBuffer(maxQueueLen));
+            break;
+        case TaskQueueType::FAIR_DRR:
+            gen->fair = new FairQueue(maxQueueLen, FairMode::DRR, fullOperate);
+            gen->queue.reset(gen->fair);
+            break;
+        case TaskQueueType::FAIR_WFQ:
+            gen->fair = new FairQueue(maxQueueLen, FairMode::WFQ, fullOperate);
+            gen->queue.reset(gen->fair);
             break;
     }
+    return gen;
+}
+
+//阈值为0时按队列长度和minSize取默认值，调用方持有mtxOfThreads或在构造中
+void ThreadPool::setThreshold(int busyThreshold, int freeThreshold){
+    busyThred = busyThreshold;
+    freeThred = freeThreshold;
     if(maxSize > minSize){
-        if(busyThreshold == 0){
-            busyThreshold = maxQueueLen >> 1;
+        if(busyThred == 0){
+            busyThred = queueLen >> 1;
+        }
+        if(freeThred == 0){
+            freeThred = minSize >> 1;
+        }
+    }
+}
+
+PoolConfig ThreadPool::getConfig(){
+    std::lock_guard<std::mutex> lock(mtxOfThreads);
+    return PoolConfig{minSize, maxSize, queueLen, busyThred, freeThred, tqType};
+}
+
+void ThreadPool::reconfigure(const PoolConfig& config){
+    QueueGen* old = nullptr;
+    {
+        std::lock_guard<std::mutex> clock(mtxOfConfig);
+        if(config.queueType != tqType || config.maxQueueLen != queueLen){
+            QueueGen* gen = makeQueue(config.queueType, config.maxQueueLen);
+            //worker持锁访问队列，替换后它们只会看到新队列
+            std::lock_guard<std::mutex> lock(mtxOfTaskQueuePtr);
+            old = queueGen.exchange(gen);
+        }
+
+        //getConfig持mtxOfThreads读，tqType和queueLen一起在这里写
+        std::lock_guard<std::mutex> lock(mtxOfThreads);
+        tqType = config.queueType;
+        queueLen = config.maxQueueLen;
+        minSize = max(1, config.minThreads);
+        maxSize = config.maxThreads;
+        setThreshold(config.busyThreshold, config.freeThreshold);
+        if(!isShutDown.load()){
+            if(initType == InitType::HUNGER){
+                while(size < minSize){
+                    threads.push_back(spawnWorker(size));
+                    ++size;
+                }
+            }
+            //构造时不需要动态调整的线程池，现在需要扩容或回收
+            if(!scaler.joinable() && (maxSize > minSize || size > minSize)){
+                scaler = spawn(ThreadLane::SCALER, -1, [this](){ dynamicScale(); });
+            }
+            cvOfScaler.notify_all();
         }
-        if(freeThreshold == 0){
-            freeThreshold = minSize >> 1;
+    }
+    //迁移时不持mtxOfConfig，并发的reconfigure不用等迁移完
+    if(old) migrate(old);
+}
+
+/*
+    等旧队列的锁外访问者全部退出，之后不会再有任务进入旧队列。
+    任务迁移到迁移时的当前一代，每次重试重新登记：迁移期间又被替换的一代由下一次迁移接着搬走，
+    不会把任务放进已经没有worker消费的队列。
+*/
+void ThreadPool::migrate(QueueGen* from){
+    while(from->users.load() > 0){
+        std::this_thread::yield();
+    }
+    if(from->fair){
+        QueueRef to(*this);
+        if(to.fair()) to.fair()->copyTenants(*from->fair);
+    }
+
+    CallBack func;
+    int tenant = 0;
+    while(from->fair ? from->fair->dequeue(tenant, func) : from->queue->dequeue(func)){
+        while(true){
+            {
+                QueueRef to(*this);
+                if(to.fair() ? to.fair()->enqueue(tenant, std::move(func)) : to->enqueue(std::move(func))) break;
+            }
+            std::this_thread::yield();
         }
+        cvOfTaskQueuePtr.notify_one();
+    }
+    from->queue.reset();
+    from->fair = nullptr;
+}
+
+void ThreadPool::registerHandler(uint32_t id, DurableHandler handler){
+    std::lock_guard<std::mutex> lock(mtxOfDurable);
+    durableHandlers[id] = std::move(handler);
+}
+
+DurableHandler ThreadPool::durableHandler(uint32_t id){
+    std::lock_guard<std::mutex> lock(mtxOfDurable);
+    auto it = durableHandlers.find(id);
+    if(it == durableHandlers.end()){
+        throw std::invalid_argument("unregistered durable handler " + std::to_string(id));
     }
+    return it->second;
+}
+
+//执行完(包括抛出异常)才确认，没有执行的任务留在日志中
+void ThreadPool::runDurable(DurableLog* log, uint64_t pos, const DurableHandler& handler, const std::string& payload){
+    try{
+        handler(payload);
+    }catch (...){
+        log->ack(pos);
+        throw;
+    }
+    log->ack(pos);
+}
+
+size_t ThreadPool::openDurable(const std::string& path, const DurableOptions& options){
+    DurableLog* log;
+    std::vector<DurableRecord> records;
+    std::vector<DurableHandler> handlers;
+    {
+        std::lock_guard<std::mutex> lock(mtxOfDurable);
+        if(durableLog){
+            throw std::logic_error("durable queue already opened");
+        }
+        std::unique_ptr<DurableLog> opened(new DurableLog(path, options));
+        records = opened->pending();
+        //先检查全部handler，不重放半个日志
+        for(auto& rec: records){
+            auto it = durableHandlers.find(rec.handler);
+            if(it == durableHandlers.end()){
+                throw std::invalid_argument("unregistered durable handler " + std::to_string(rec.handler));
+            }
+            handlers.push_back(it->second);
+        }
+        durableLog = std::move(opened);
+        log = durableLog.get();
+    }
+    //队列满时等待worker腾出位置，重放的任务不丢弃
+    for(size_t i = 0; i < records.size(); ++i){
+        uint64_t pos = records[i].pos;
+        auto payload = std::make_shared<std::string>(std::move(records[i].payload));
+        DurableHandler handler = std::move(handlers[i]);
+        post([log, pos, handler, payload](){
+            runDurable(log, pos, handler, *payload);
+        });
+    }
+    return records.size();
+}
+
+std::future<void> ThreadPool::submitDurable(uint32_t handler, const std::string& payload){
+    DurableHandler func = durableHandler(handler);
+    DurableLog* log;
+    {
+        std::lock_guard<std::mutex> lock(mtxOfDurable);
+        log = durableLog.get();
+    }
+    if(!log){
+        throw std::logic_error("durable queue not opened");
+    }
+    uint64_t pos;
+    if(!log->append(handler, payload.data(), payload.size(), pos)){
+        rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+        if(fullOperate == FullOperate::EXCEPTION){
+            throw TaskQueueFullException();
+        }
+        return std::future<void>();
+    }
+    //没能入队的任务立即确认，不留到重放
+    std::future<void> res;
+    try{
+        res = submit([log, pos, func, payload](){
+            runDurable(log, pos, func, payload);
+        });
+    }catch (...){
+        log->ack(pos);
+        throw;
+    }
+    if(!res.valid()){
+        log->ack(pos);
+    }
+    return res;
+}
+
+void ThreadPool::registerProcessHandler(uint32_t id, ProcessHandler handler){
+    std::lock_guard<std::mutex> lock(mtxOfProcess);
+    if(processes){
+        throw std::logic_error("process handlers must be registered before startProcesses");
+    }
+    processHandlers[id] = std::move(handler);
+}
+
+void ThreadPool::startProcesses(int n, const ProcessOptions& options){
+    std::lock_guard<std::mutex> lock(mtxOfProcess);
+    if(processes){
+        throw std::logic_error("process workers already started");
+    }
+    processes.reset(new ProcessWorkers(n, processHandlers, options));
+}
+
+std::future<std::string> ThreadPool::submitProcess(uint32_t handler, const std::string& payload){
+    ProcessWorkers* workers;
+    {
+        std::lock_guard<std::mutex> lock(mtxOfProcess);
+        workers = processes.get();
+    }
+    if(!workers){
+        throw std::logic_error("process workers not started");
+    }
+    std::future<std::string> res;
+    if(!workers->submit(handler, payload, res)){
+        rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+        if(fullOperate == FullOperate::EXCEPTION){
+            throw TaskQueueFullException();
+        }
+    }
+    return res;
+}
+
+long long ThreadPool::getProcessRestarts(){
+    std::lock_guard<std::mutex> lock(mtxOfProcess);
+    return processes ? processes->getRestarts() : 0;
 }
 
 void ThreadPool::start(){
+    std::lock_guard<std::mutex> lock(mtxOfThreads);
     isShutDown.store(false);
+    {
+        //例如nice -n 10、chrt启动的进程，未设置的通道保持这些属性
+        sched_param param;
+        pthread_getschedparam(pthread_self(), &baseAttr.policy, &param);
+        baseAttr.priority = param.sched_priority;
+        baseAttr.nice = getpriority(PRIO_PROCESS, 0);
+    }
     if(initType == InitType::HUNGER){
-        for(int i = 0; i < minSize; ++i){
-            threads.push_back( std::move(std::thread(ThreadWork(this, i))) );
+        //按二叉树并行创建：worker i先创建2i+1和2i+2再开始取任务，全部创建完再返回
+        threads.resize(minSize);
+        spawnPending = minSize;
+        spawnError = nullptr;
+        threads[0] = spawnWorker(0, minSize);
+        {
+            std::unique_lock<std::mutex> slock(mtxOfSpawn);
+            cvOfSpawn.wait(slock, [this](){ return spawnPending == 0; });
         }
         size = minSize;
         // std::cout << "1" << std::endl;
     }
     if(maxSize > minSize){
         //动态调整
-        std::cout << "create detached thread" << std::endl;
-        std::thread dynamicScaler(std::bind(&ThreadPool::dynamicScale, this));
-        dynamicScaler.detach();
+        scaler = spawn(ThreadLane::SCALER, -1, [this](){ dynamicScale(); });
+    }
+    //部分worker创建失败，已创建的照常工作
+    if(spawnError){
+        std::rethrow_exception(spawnError);
     }
 }
 
-void ThreadPool::shutdown(){
-    int t = 100;
-    while(!taskQueuePtr->empty()){
-        std::this_thread::sleep_for(std::chrono::milliseconds(t));
-        t <<= 1;
+//在worker tid中创建它的子worker，失败时整棵子树都不会创建
+void ThreadPool::prespawn(int tid, int n){
+    int done = 1;
+    for(int c = 2 * tid + 1; c <= 2 * tid + 2 && c < n; ++c){
+        try{
+            threads[c] = spawnWorker(c, n);
+        }catch (...){
+            std::lock_guard<std::mutex> lock(mtxOfSpawn);
+            if(!spawnError) spawnError = std::current_exception();
+            for(int lo = c, hi = c; lo < n; lo = 2 * lo + 1, hi = 2 * hi + 2){
+                done += (hi < n ? hi : n - 1) - lo + 1;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(mtxOfSpawn);
+    spawnPending -= done;
+    if(spawnPending == 0){
+        cvOfSpawn.notify_all();
+    }
+}
+
+PoolThread ThreadPool::spawn(ThreadLane lane, int tid, std::function<void()> body){
+    ThreadInfo info{lane, tid, threadName, laneAttrs[int(lane)], baseAttr};
+    switch (lane)
+    {
+        case ThreadLane::WORKER: info.name += "-w" + std::to_string(tid); break;
+        case ThreadLane::URGENT: info.name += "-u" + std::to_string(tid); break;
+        case ThreadLane::SPARE: info.name += "-s"; break;
+        case ThreadLane::SCALER: info.name += "-scaler"; break;
+    }
+    if(threadFactory){
+        return threadFactory(info, std::move(body));
+    }
+    return PoolThread(info, std::move(body));
+}
+
+PoolThread ThreadPool::spawnWorker(int tid, int n){
+    ThreadLane lane = (tid == 0 && threadPoolType == TheadPoolType::COMPOSITE) ? ThreadLane::URGENT : ThreadLane::WORKER;
+    return spawn(lane, tid, ThreadWork(this, tid, nullptr, n));
+}
+
+void ThreadPool::setThreadName(const std::string& prefix){
+    std::lock_guard<std::mutex> lock(mtxOfThreads);
+    threadName = prefix;
+}
+void ThreadPool::setThreadAttr(ThreadLane lane, const ThreadAttr& attr){
+    std::lock_guard<std::mutex> lock(mtxOfThreads);
+    laneAttrs[int(lane)] = attr;
+}
+void ThreadPool::setThreadFactory(ThreadFactory factory){
+    std::lock_guard<std::mutex> lock(mtxOfThreads);
+    threadFactory = std::move(factory);
+}
+
+bool ThreadPool::shutdown(ShutdownMode mode, std::chrono::milliseconds timeout){
+    bool drained = true;
+    //线程池任务和进程任务共用一个timeout
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if(timeout != std::chrono::milliseconds::max()){
+        deadline = std::chrono::steady_clock::now() + timeout;
+    }
+    if(mode == ShutdownMode::DRAIN){
+        std::unique_lock<std::mutex> lock(mtxOfIdle);
+        auto idle = [this](){ return pendingTasks.load() == 0; };
+        if(timeout == std::chrono::milliseconds::max()){
+            cvOfIdle.wait(lock, idle);
+        }else{
+            drained = cvOfIdle.wait_until(lock, deadline, idle);
+        }
+    }
+
+    stopIo();
+    ProcessWorkers* workers;
+    {
+        std::lock_guard<std::mutex> lock(mtxOfProcess);
+        workers = processes.get();
+    }
+    if(workers && !workers->stop(!drained || mode == ShutdownMode::ABORT, deadline)){
+        drained = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtxOfTaskQueuePtr);
+        isShutDown.store(true);
     }
-    isShutDown.store(true);
     cvOfTaskQueuePtr.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mtxOfSpare);
+    }
+    cvOfSpare.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mtxOfThreads);
+    }
+    cvOfScaler.notify_all();
+    //dynamicScale可能正在join一个执行长任务的worker，先丢弃排队的任务再等它
+    if(!drained || mode == ShutdownMode::ABORT){
+        discardPending();
+    }
+    if(scaler.joinable()){
+        scaler.join();
+    }
     
     for(int i = 0; i < size; ++i){
         if(threads.at(i).joinable()){
@@ -120,6 +566,157 @@ void ThreadPool::shutdown(){
     }
     size = 0;
     threads.resize(size);
+
+    //补偿线程可能正在parkSpare中等待mtxOfSpare，移出链表后在锁外join
+    std::list<Spare> exiting;
+    {
+        std::lock_guard<std::mutex> lock(mtxOfSpare);
+        exiting.splice(exiting.end(), spares);
+        idleSpares = spareTickets = 0;
+        activeSpares.store(0);
+    }
+    for(auto& sp: exiting){
+        if(sp.th.joinable()){
+            sp.th.join();
+        }
+    }
+
+    //线程退出期间仍可能有任务入队
+    discardPending();
+    return drained;
+}
+
+void ThreadPool::taskDone(){
+    if(pendingTasks.fetch_sub(1) == 1){
+        std::lock_guard<std::mutex> lock(mtxOfIdle);
+        cvOfIdle.notify_all();
+    }
+}
+
+//丢弃排队中的任务，packaged_task析构后future得到broken_promise
+void ThreadPool::discardPending(){
+    CallBack func;
+    {
+        QueueRef queue(*this);
+        while(queue->dequeue(func)){
+            func = nullptr;
+            taskDone();
+        }
+    }
+    if(urgTaskQueuePtr){
+        while(urgTaskQueuePtr->dequeue(func)){
+            func = nullptr;
+            taskDone();
+        }
+    }
+    for(int i = 0; i < slotCount; ++i){
+        if(slots[i].take(func)){
+            func = nullptr;
+            taskDone();
+        }
+    }
+    while(takeOverflow(func)){
+        func = nullptr;
+        taskDone();
+    }
+}
+
+void ThreadPool::enterBlocking(){
+    blockingThreads.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(mtxOfSpare);
+        if(!needSpare()) return;
+    }
+
+    /*
+        创建补偿线程需要mtxOfThreads。dynamicScale持锁join正在退出的worker时，那个worker可能就是当前线程，
+        不能等锁：记下缺口，dynamicScale join完后补上。先记缺口再重查，与dynamicScale先清标志再取缺口配对。
+    */
+    std::unique_lock<std::mutex> tlock(mtxOfThreads, std::defer_lock);
+    while(!tlock.try_lock()){
+        if(scalerJoining.load()){
+            spareDeficit.store(true);
+            if(scalerJoining.load()) return;
+        }
+        std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(mtxOfSpare);
+    addSpares();
+}
+
+//阻塞的worker多于活跃的补偿线程时先唤醒空闲的补偿线程，还不够返回true。调用方持有mtxOfSpare
+bool ThreadPool::needSpare(){
+    if(isShutDown.load() || activeSpares.load() >= blockingThreads.load()) return false;
+    if(idleSpares > 0){
+        --idleSpares;
+        ++spareTickets;
+        activeSpares.fetch_add(1);
+        cvOfSpare.notify_one();
+        return false;
+    }
+    return true;
+}
+
+//补足补偿线程，总线程数不超过maxSize。调用方持有mtxOfThreads和mtxOfSpare
+void ThreadPool::addSpares(){
+    while(needSpare()){
+        reapSpares();
+        if(size + liveSpares.load() >= maxSize) return;
+
+        spares.emplace_back();
+        activeSpares.fetch_add(1);
+        liveSpares.fetch_add(1);
+        try{
+            spares.back().th = spawn(ThreadLane::SPARE, -1, ThreadWork(this, -1, &spares.back()));
+        }catch (std::exception& e){
+            //创建失败时阻塞的worker没有补偿，不影响正确性
+            std::cerr << e.what() << std::endl;
+            spares.pop_back();
+            activeSpares.fetch_sub(1);
+            liveSpares.fetch_sub(1);
+            return;
+        }
+    }
+}
+
+void ThreadPool::leaveBlocking(){
+    blockingThreads.fetch_sub(1);
+}
+
+bool ThreadPool::retireSpare(){
+    if(activeSpares.load() <= blockingThreads.load()) return false;
+    std::lock_guard<std::mutex> lock(mtxOfSpare);
+    if(activeSpares.load() <= blockingThreads.load()) return false;
+    activeSpares.fetch_sub(1);
+    ++idleSpares;
+    return true;
+}
+
+bool ThreadPool::parkSpare(){
+    std::unique_lock<std::mutex> lock(mtxOfSpare);
+    cvOfSpare.wait_for(lock, std::chrono::milliseconds(1000), [this](){
+        return spareTickets > 0 || isShutDown.load();
+    });
+    if(spareTickets > 0){
+        --spareTickets;
+        return !isShutDown.load();
+    }
+    --idleSpares;
+    return false;
+}
+
+//回收已退出的补偿线程，调用方持有mtxOfSpare
+void ThreadPool::reapSpares(){
+    for(auto it = spares.begin(); it != spares.end(); ){
+        if(it->done.load()){
+            if(it->th.joinable()){
+                it->th.join();
+            }
+            it = spares.erase(it);
+        }else{
+            ++it;
+        }
+    }
 }
 
 ThreadPool::~ThreadPool(){
@@ -130,6 +727,165 @@ ThreadPool::~ThreadPool(){
 
 
 
+IoReactor& ThreadPool::io(){
+    IoReactor* r = reactorPtr.load(std::memory_order_acquire);
+    if(r) return *r;
+
+    std::lock_guard<std::mutex> lock(mtxOfReactor);
+    if(!reactor){
+        reactor = IoReactor::create([this](CallBack&& callBack){
+            post(std::move(callBack));
+        }, ioBackend);
+        reactorPtr.store(reactor.get(), std::memory_order_release);
+    }
+    return *reactor;
+}
+
+void ThreadPool::stopIo(){
+    std::lock_guard<std::mutex> lock(mtxOfReactor);
+    if(reactor){
+        reactor->stop();
+        reactorPtr.store(nullptr);
+        reactor.reset();
+    }
+}
+
+bool ThreadPool::enqueue(const SubmitOptions& opt, CallBack&& callBack){
+    //先计数再入队，避免任务执行完时计数还没加上
+    pendingTasks.fetch_add(1);
+
+    QueueRef queue(*this);
+    //worker内部提交走本地槽位；公平队列下不绕过租户调度
+    if(currentPool == this && currentTid >= 0 && currentTid < slotCount && !queue.fair()){
+        if(enqueueLocal(queue, std::move(callBack))) return true;
+        taskDone();
+        return false;
+    }
+
+    bool res = queue.fair() ? queue.fair()->enqueue(opt.tenant, std::move(callBack))
+                            : queue->enqueue(std::move(callBack));
+    if(!res){
+        taskDone();
+    }
+    return res;
+}
+
+//放进当前worker的槽位，被挤出的任务进共享队列；共享队列满时还原并失败
+bool ThreadPool::enqueueLocal(const QueueRef& queue, CallBack&& callBack){
+    WorkerSlot& slot = slots[currentTid];
+    CallBack task = std::move(callBack);
+    slot.exchange(task);
+    if(task){
+        if(!queue->enqueue(std::move(task))){
+            //新任务可能已经被偷走执行，只有还在槽位里才算失败
+            CallBack mine;
+            bool rejected = slot.take(mine);
+            slot.exchange(task);
+            return !rejected;
+        }
+        cvOfTaskQueuePtr.notify_one();
+    }else if(blockedThreads.load() > 0){
+        //有空闲worker时唤醒一个，当前worker长时间不返回也能被偷走
+        cvOfTaskQueuePtr.notify_one();
+    }
+    return true;
+}
+
+bool ThreadPool::stealTask(int tid, CallBack& func){
+    int start = tid < 0 ? 0 : tid;
+    for(int i = 0; i < slotCount; ++i){
+        if(slots[(start + i) % slotCount].take(func)) return true;
+    }
+    return false;
+}
+
+//公平队列按租户各自的队满操作
+FullOperate ThreadPool::fullOperateOf(const SubmitOptions& opt){
+    QueueRef queue(*this);
+    if(queue.fair()){
+        return queue.fair()->fullOperate(opt.tenant);
+    }
+    return fullOperate;
+}
+
+bool ThreadPool::setTenant(int tenant, int weight, int maxQueueLen){
+    return setTenant(tenant, weight, maxQueueLen, fullOperate);
+}
+bool ThreadPool::setTenant(int tenant, int weight, int maxQueueLen, FullOperate fo){
+    QueueRef queue(*this);
+    if(!queue.fair()) return false;
+    queue.fair()->setTenant(tenant, weight, maxQueueLen, fo);
+    return true;
+}
+
+//完成回调不能丢弃，队列满时等待worker腾出位置
+void ThreadPool::post(CallBack&& callBack){
+    CallBack task = [callBack](){
+        try{
+            callBack();
+        }catch (std::exception& e){
+            //LOG e.what()
+            std::cerr << e.what() << std::endl;
+        }
+    };
+    pendingTasks.fetch_add(1);
+    pushShared(std::move(task));
+}
+
+/*
+    队列满时等待worker腾出位置；每次重试重新登记，不阻塞reconfigure迁移。
+    调用方是本线程池的worker(Strand续投、异步收发的续体等)时不等待，放进溢出队列，
+    否则所有worker都在这里等待时没有人取任务。
+*/
+void ThreadPool::pushShared(CallBack&& task){
+    while(true){
+        {
+            QueueRef queue(*this);
+            if(queue->enqueue(std::move(task))) break;
+        }
+        if(currentPool == this){
+            {
+                std::lock_guard<std::mutex> lock(mtxOfOverflow);
+                overflow.push_back(std::move(task));
+                overflowLen.fetch_add(1);
+            }
+            //worker持mtxOfTaskQueuePtr检查overflowLen后才等待，经过这把锁再通知不会错过
+            {
+                std::lock_guard<std::mutex> lock(mtxOfTaskQueuePtr);
+            }
+            break;
+        }
+        std::this_thread::yield();
+    }
+    cvOfTaskQueuePtr.notify_one();
+}
+
+bool ThreadPool::takeOverflow(CallBack& task){
+    std::lock_guard<std::mutex> lock(mtxOfOverflow);
+    if(overflow.empty()) return false;
+    task = std::move(overflow.front());
+    overflow.pop_front();
+    overflowLen.fetch_sub(1);
+    return true;
+}
+
+const CancellationToken& ThreadPool::currentToken(){
+    static const CancellationToken never;
+    return runningToken ? *runningToken : never;
+}
+
+ThreadPool::BlockingScope::BlockingScope(ThreadPool& _pool)
+: pool(currentPool == &_pool ? &_pool : nullptr)
+{
+    if(pool) pool->enterBlocking();
+}
+
+ThreadPool::BlockingScope::~BlockingScope(){
+    if(pool) pool->leaveBlocking();
+}
+
+
+
 ComposeThreadPool::ComposeThreadPool(int maxUrgTask, int minThreads, int maxThreads, int maxQueueLen, int busyThreshold,
  int freeThreshold, InitType it, TaskQueueType tt, FullOperate fo)
  : ThreadPool(minThreads, maxThreads, maxQueueLen, busyThreshold, freeThreshold, it, tt, fo)
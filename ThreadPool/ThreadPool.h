@@ -9,18 +9,30 @@
 #include <future>
 #include <string>
 #include <chrono>
+#include <list>
+#include <deque>
+#include <exception>
+#include <stdexcept>
 #include <iostream>
 
 #include <execinfo.h>
 #include <dlfcn.h>
 
 #include "TaskQueue.h"
+#include "IoReactor.h"
+#include "CoDel.h"
+#include "Cancellation.h"
+#include "PoolThread.h"
+#include "DurableLog.h"
+#include "ProcessWorkers.h"
 
 enum class TaskQueueType{
     BLOCK_QUEUE,
     BLOCK_RINGBUFFER,
     LOCKFREE_QUEUE,
-    LOCKFREE_RINGBUFFER
+    LOCKFREE_RINGBUFFER,
+    FAIR_DRR,
+    FAIR_WFQ
 };
 
 //核心线程的创建时机
@@ -28,31 +40,223 @@ enum class InitType{
     LAZY,
     HUNGER
 };
-//任务队列满后的操作
-enum class FullOperate{
-    REJECT,
-    EXCEPTION
+//shutdown方式
+enum class ShutdownMode{
+    DRAIN,  //等待已提交的任务全部执行完
+    ABORT   //丢弃排队中的任务，future得到broken_promise
 };
 enum class TheadPoolType{
     PLAIN,
     COMPOSITE
 };
 
+//租户标识，任务队列为FAIR_DRR/FAIR_WFQ时生效
+struct Tenant{
+    int id;
+};
+
+//线程池运行参数，getConfig取出后修改再交给reconfigure
+struct PoolConfig{
+    int minThreads;
+    int maxThreads;         //不大于minThreads时不动态调整
+    int maxQueueLen;
+    int busyThreshold;      //动态调整时为0取maxQueueLen/2
+    int freeThreshold;      //动态调整时为0取minThreads/2
+    TaskQueueType queueType;
+};
+
+//任务截止时间，worker取出时已过期的任务不再执行
+struct Deadline{
+    std::chrono::steady_clock::time_point at;
+
+    template<typename Rep, typename Period>
+    static Deadline after(std::chrono::duration<Rep, Period> d){
+        return Deadline{std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(d)};
+    }
+};
+
+//submit的可选参数
+struct SubmitOptions{
+    int tenant;
+    std::chrono::steady_clock::time_point deadline;
+    CancellationToken token;
+
+    SubmitOptions(): tenant(0), deadline(std::chrono::steady_clock::time_point::max()) {}
+    SubmitOptions(Tenant t): SubmitOptions() { tenant = t.id; }
+    SubmitOptions(Deadline d): SubmitOptions() { deadline = d.at; }
+    SubmitOptions(CancellationToken t): SubmitOptions() { token = std::move(t); }
+
+    SubmitOptions& setTenant(int t){
+        tenant = t;
+        return *this;
+    }
+    SubmitOptions& setDeadline(Deadline d){
+        deadline = d.at;
+        return *this;
+    }
+    SubmitOptions& setToken(CancellationToken t){
+        token = std::move(t);
+        return *this;
+    }
+    bool hasDeadline() const {
+        return deadline != std::chrono::steady_clock::time_point::max();
+    }
+};
+
+//任务在截止时间之后才被取出，future.get()抛出
+class TaskTimeoutException: public std::exception {
+    private:
+        std::string message;
+    public:
+        TaskTimeoutException(): message("Task deadline exceeded before it started.") {}
+        const char* what() const noexcept override {
+            return message.c_str();
+        }
+};
+
+//准入控制判定过载，submit拒绝任务(FullOperate::EXCEPTION时抛出)
+class TaskOverloadException: public std::exception {
+    private:
+        std::string message;
+    public:
+        TaskOverloadException(): message("Task rejected by admission control.") {}
+        const char* what() const noexcept override {
+            return message.c_str();
+        }
+};
+
 
 // PLAIN
 class ThreadPool{
     protected:
         
-        std::unique_ptr<TaskQueue> taskQueuePtr, urgTaskQueuePtr;
-        std::vector<std::thread> threads;
+        /*
+            任务队列的一代。reconfigure更换队列时新建一代并原子替换，等锁外访问者退出后把旧队列的任务迁移过去。
+            worker持mtxOfTaskQueuePtr访问当前一代；其他线程通过QueueRef登记为访问者。
+            旧的一代迁移完后释放队列，外壳保留到析构，晚到的访问者只会读到它的计数。
+        */
+        struct QueueGen{
+            std::unique_ptr<TaskQueue> queue;
+            FairQueue* fair;            //queue为公平队列时指向它，否则为nullptr
+            std::atomic<int> users{0};
+        };
+        std::atomic<QueueGen*> queueGen;
+        std::vector<std::unique_ptr<QueueGen>> queueGens;
+        class QueueRef{
+            private:
+                QueueGen* gen;
+            public:
+                explicit QueueRef(ThreadPool& pool);
+                ~QueueRef(){ gen->users.fetch_sub(1, std::memory_order_release); }
+                QueueRef(const QueueRef&) = delete;
+                QueueRef& operator=(const QueueRef&) = delete;
+                TaskQueue* operator->() const { return gen->queue.get(); }
+                FairQueue* fair() const { return gen->fair; }
+        };
+
+        std::unique_ptr<TaskQueue> urgTaskQueuePtr;
+        std::vector<PoolThread> threads;
         volatile std::atomic<bool> isShutDown;
         volatile std::atomic<int> blockedThreads;
         int size, minSize, maxSize, busyThred, freeThred;
         int freeId;
+        int queueLen;
 
-        std::mutex mtxOfTaskQueuePtr, mtxOfThreads;
+        std::mutex mtxOfTaskQueuePtr, mtxOfThreads, mtxOfConfig;
         std::condition_variable cvOfTaskQueuePtr;
 
+        //已入队还没执行完的任务数，归零时通知shutdown
+        std::atomic<int> pendingTasks;
+
+        //worker投递内部任务时共享队列已满，放进不限长的溢出队列，不自旋等待只有worker才能腾出的位置
+        std::deque<CallBack> overflow;
+        std::atomic<int> overflowLen{0};
+        std::mutex mtxOfOverflow;
+        std::mutex mtxOfIdle;
+        std::condition_variable cvOfIdle;
+
+        PoolThread scaler;
+        std::condition_variable cvOfScaler;
+
+        //补偿线程：worker进入阻塞区域时临时顶替它，总线程数不超过maxSize
+        struct Spare{
+            PoolThread th;
+            std::atomic<bool> done{false};
+        };
+        std::list<Spare> spares;
+        std::atomic<int> blockingThreads, activeSpares, liveSpares;
+        int idleSpares, spareTickets;
+        std::mutex mtxOfSpare;
+        std::condition_variable cvOfSpare;
+        //dynamicScale持mtxOfThreads join退出的worker时，拿不到锁的enterBlocking留下缺口，join完由它补上
+        std::atomic<bool> scalerJoining{false}, spareDeficit{false};
+
+        //当前线程所属的线程池，非worker线程为nullptr；currentTid为worker编号，补偿线程为-1
+        static thread_local ThreadPool* currentPool;
+        static thread_local int currentTid;
+
+        /*
+            worker本地的"下一个任务"槽位。worker执行中提交的任务放进自己的槽位，执行完当前任务后接着执行，
+            原来槽位里的任务挤到共享队列；空闲worker在共享队列为空时可以从其他槽位偷任务，
+            共享队列一直不空时worker也定期偷，父任务阻塞等待槽位里的子任务时不会饿死。
+        */
+        struct WorkerSlot{
+            std::atomic_flag flag = ATOMIC_FLAG_INIT;
+            std::atomic<bool> full{false};
+            CallBack task;
+
+            //放入task，原来的任务(可能为空)换回task
+            void exchange(CallBack& task);
+            bool take(CallBack& task);
+        };
+        std::unique_ptr<WorkerSlot[]> slots;
+        int slotCount;
+        static const int localBudget = 32;     //连续执行本地任务的上限，之后先看一次共享队列
+        static const int stealInterval = 16;   //每从共享队列取这么多任务，看一次其他worker的槽位
+
+        //I/O反应器，第一次异步I/O时创建，shutdown时停止
+        std::unique_ptr<IoReactor> reactor;
+        std::atomic<IoReactor*> reactorPtr;
+        IoBackend ioBackend;
+        std::mutex mtxOfReactor;
+
+        //准入控制与过期任务统计
+        CoDelAdmission codel;
+        std::atomic<long long> expiredTasks, cancelledTasks, rejectedTasks;
+
+        //当前线程正在执行的任务的取消token
+        static thread_local const CancellationToken* runningToken;
+        class TokenScope{
+            private:
+                const CancellationToken* prev;
+            public:
+                TokenScope(const CancellationToken& token): prev(runningToken) { runningToken = &token; }
+                ~TokenScope() { runningToken = prev; }
+        };
+
+        //线程名前缀、各通道的线程属性和自定义创建方式，mtxOfThreads保护
+        //baseAttr是start时调用线程的调度属性，作为各通道未设置字段的默认值
+        std::string threadName;
+        ThreadAttr laneAttrs[4];
+        ThreadAttr baseAttr;
+        ThreadFactory threadFactory;
+
+        //持久化队列：handler按编号注册，日志在openDurable时打开
+        std::unordered_map<uint32_t, DurableHandler> durableHandlers;
+        std::unique_ptr<DurableLog> durableLog;
+        std::mutex mtxOfDurable;
+
+        //多进程worker，handler在startProcesses前注册
+        std::unordered_map<uint32_t, ProcessHandler> processHandlers;
+        std::unique_ptr<ProcessWorkers> processes;
+        std::mutex mtxOfProcess;
+
+        //HUNGER并行创建时还没创建完的线程数
+        int spawnPending;
+        std::exception_ptr spawnError;
+        std::mutex mtxOfSpawn;
+        std::condition_variable cvOfSpawn;
+
         InitType initType;
         TaskQueueType tqType;
         FullOperate fullOperate;
@@ -63,29 +267,173 @@ class ThreadPool{
             private:
                 ThreadPool* pool;
                 int tid;
+                Spare* spare;
+                int prespawn;   //大于0时先创建二叉树中的子worker
             public:
-                ThreadWork(ThreadPool* _pool, int id);
+                ThreadWork(ThreadPool* _pool, int id, Spare* sp = nullptr, int n = 0);
                 void operator()();
         };
         ThreadPool() = delete;
+
+        friend class Strand;
+        template<typename T, typename Lock> friend class Channel;
+        friend class Select;
+        friend class Pipeline;
+
+        void enterBlocking();
+        void leaveBlocking();
+        bool needSpare();
+        void addSpares();
+        bool retireSpare();
+        bool parkSpare();
+        void reapSpares();
+
+        IoReactor& io();
+        void post(CallBack&& callBack);
+        void pushShared(CallBack&& task);
+        bool takeOverflow(CallBack& task);
+
+        bool enqueue(const SubmitOptions& opt, CallBack&& callBack);
+        bool enqueueLocal(const QueueRef& queue, CallBack&& callBack);
+        bool stealTask(int tid, CallBack& func);
+        void taskDone();
+        void discardPending();
+        FullOperate fullOperateOf(const SubmitOptions& opt);
+        void stopIo();
+
+        QueueGen* makeQueue(TaskQueueType tt, int maxQueueLen);
+        void migrate(QueueGen* from);
+        void setThreshold(int busyThreshold, int freeThreshold);
+
+        DurableHandler durableHandler(uint32_t id);
+        static void runDurable(DurableLog* log, uint64_t pos, const DurableHandler& handler, const std::string& payload);
+
+        PoolThread spawn(ThreadLane lane, int tid, std::function<void()> body);
+        PoolThread spawnWorker(int tid, int prespawn = 0);
+        void prespawn(int tid, int n);
     public:
+        /*
+            RAII标记当前worker即将阻塞(磁盘、RPC、sleep等)。
+            作用域内线程池会激活或创建一个补偿线程继续消费任务，离开作用域后补偿线程退役。
+            不在本线程池worker上调用时什么也不做。
+        */
+        class BlockingScope{
+            private:
+                ThreadPool* pool;
+            public:
+                explicit BlockingScope(ThreadPool& _pool);
+                ~BlockingScope();
+                BlockingScope(const BlockingScope&) = delete;
+                BlockingScope& operator=(const BlockingScope&) = delete;
+        };
+
+        /*
+            运行中的任务轮询自己是否已被取消，只对带token提交的任务有意义。
+            在任务之外调用得到永不取消的空token。
+        */
+        static const CancellationToken& currentToken();
+        static bool cancellationRequested(){
+            return runningToken && runningToken->isCancelled();
+        }
+
+        template<typename F>
+        auto blocking(F&& f) -> decltype(f()){
+            BlockingScope scope(*this);
+            return f();
+        }
+
+        /*
+            异步I/O，由reactor线程等待完成，handler作为任务投递到任务队列中执行，不占用worker。
+            buf需保持有效直到handler执行。offset为-1时使用fd当前偏移。
+        */
+        void asyncRead(int fd, void* buf, size_t len, IoHandler handler, off_t offset = -1){
+            io().read(fd, buf, len, offset, std::move(handler));
+        }
+        void asyncWrite(int fd, const void* buf, size_t len, IoHandler handler, off_t offset = -1){
+            io().write(fd, buf, len, offset, std::move(handler));
+        }
+        void asyncAccept(int fd, IoHandler handler){
+            io().accept(fd, std::move(handler));
+        }
+        //需要在第一次异步I/O之前设置
+        void setIoBackend(IoBackend backend){
+            ioBackend = backend;
+        }
+        IoBackend getIoBackend(){
+            return io().backend();
+        }
+
         ThreadPool(int minThreads, int maxThreads = 0, int maxQueueLen = 500, int busyThreshold = 0,
          int freeThreshold = 0, InitType it = InitType::HUNGER, TaskQueueType tt = TaskQueueType::LOCKFREE_RINGBUFFER, FullOperate fo = FullOperate::REJECT);
         ~ThreadPool();
+
+        /*
+            线程名为"前缀-w编号"(worker)、"前缀-u0"(优先队列worker)、"前缀-s"(补偿线程)、"前缀-scaler"，默认前缀pool。
+            线程属性按通道设置，自定义factory可以包装body做绑核等初始化，默认用PoolThread按属性创建。
+            都只对之后创建的线程生效，一般在start之前调用。HUNGER并行创建时factory会在worker线程中被调用。
+        */
+        void setThreadName(const std::string& prefix);
+        void setThreadAttr(ThreadLane lane, const ThreadAttr& attr);
+        void setThreadFactory(ThreadFactory factory);
         
         virtual void start();
 
-        void shutdown();
+        /*
+            DRAIN：等待已提交的任务执行完(不轮询，最后一个任务完成时被唤醒)，超过timeout则按ABORT处理剩余任务。
+            进程任务共用同一个timeout，超时时杀掉worker进程，未完成任务的future得到ProcessCrashedException。
+            ABORT：立即丢弃排队中的任务，对应future得到broken_promise，正在执行的任务执行完。
+            两种方式都会join所有线程，包括动态调整线程和补偿线程。不能在本线程池的任务中调用。
+            返回false表示DRAIN超时，有任务被丢弃。
+        */
+        bool shutdown(ShutdownMode mode = ShutdownMode::DRAIN, std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
 
         template<typename F, typename... Args>
         auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))>{
+            return submit(SubmitOptions(), std::forward<F>(f), std::forward<Args>(args)...);
+        }
+
+        template<typename F, typename... Args>
+        auto submit(const SubmitOptions& opt, F&& f, Args&&... args) -> std::future<decltype(f(args...))>{
+            using R = decltype(f(args...));
             auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+
+            //过载时在入队前拒绝
+            if(codel.isEnabled() && !codel.admit(QueueRef(*this)->size())){
+                rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+                if(fullOperateOf(opt) == FullOperate::EXCEPTION){
+                    throw TaskOverloadException();
+                }
+                return std::future<R>();
+            }
             
             // 使用智能指针防止局部变量释放导致内存泄漏
-            auto taskPtr = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+            std::shared_ptr<std::packaged_task<R()>> taskPtr;
+            if(opt.hasDeadline() || opt.token.canBeCancelled()){
+                //取消或过期的任务不执行，异常交给future
+                auto deadline = opt.deadline;
+                auto token = opt.token;
+                taskPtr = std::make_shared<std::packaged_task<R()>>([this, func, deadline, token]() mutable -> R {
+                    if(token.isCancelled()){
+                        cancelledTasks.fetch_add(1, std::memory_order_relaxed);
+                        throw TaskCancelledException();
+                    }
+                    if(deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > deadline){
+                        expiredTasks.fetch_add(1, std::memory_order_relaxed);
+                        throw TaskTimeoutException();
+                    }
+                    TokenScope scope(token);
+                    return func();
+                });
+            }else{
+                taskPtr = std::make_shared<std::packaged_task<R()>>(func);
+            }
             
             
-            CallBack callBack = [taskPtr](){
+            int64_t enqueueNs = codel.isEnabled() ? CoDelAdmission::now() : 0;
+            CallBack callBack = [this, taskPtr, enqueueNs](){
+                if(enqueueNs){
+                    codel.onDequeue(enqueueNs);
+                }
                 try{
                     (*taskPtr)();
                 }catch (std::exception& e){
@@ -100,54 +448,137 @@ class ThreadPool{
             if(initType == InitType::LAZY && (int)(blockedThreads.load()) == 0){
                 std::lock_guard<std::mutex> lock(mtxOfThreads);
                 if(size < minSize){
-                    threads.push_back( std::move(std::thread(ThreadWork(this, size))) );
+                    threads.push_back(spawnWorker(size));
                     ++size;
                     std::cout << "LAZY" << std::endl;
                 }
             }
             
             //入队，一次性
-            bool res = taskQueuePtr->enqueue(std::move(callBack));
+            bool res = enqueue(opt, std::move(callBack));
             if(res){
                 cvOfTaskQueuePtr.notify_one();
                 // std::cout << "submit one" << std::endl;
                 return taskPtr->get_future();
             }
 
-            if(fullOperate == FullOperate::EXCEPTION){
+            if(fullOperateOf(opt) == FullOperate::EXCEPTION){
                 throw TaskQueueFullException();
             }
             // fullOperate == FullOperate::REJECT
             // std::cout << "FullOperate::REJECT" << std::endl;
-            return std::future<decltype(f(args...))>();
+            return std::future<R>();
+        }
+
+        /*
+            开启CoDel式准入控制：排队时间连续interval高于target后，submit开始拒绝任务，
+            直到排队时间回落到target以下。拒绝方式同FullOperate。
+        */
+        template<typename Rep1, typename Period1, typename Rep2 = long, typename Period2 = std::milli>
+        void setAdmissionControl(std::chrono::duration<Rep1, Period1> target,
+         std::chrono::duration<Rep2, Period2> interval = std::chrono::milliseconds(100)){
+            codel.enable(std::chrono::duration_cast<std::chrono::nanoseconds>(target),
+             std::chrono::duration_cast<std::chrono::nanoseconds>(interval));
+        }
+        void disableAdmissionControl(){
+            codel.disable();
+        }
+        bool overloaded(){
+            return codel.overloaded();
+        }
+        //因过期被丢弃、被取消、被准入控制拒绝的任务数
+        long long getExpiredTasks(){
+            return expiredTasks.load();
+        }
+        long long getCancelledTasks(){
+            return cancelledTasks.load();
+        }
+        long long getRejectedTasks(){
+            return rejectedTasks.load();
         }
+
+        /*
+            配置租户的权重、子队列长度和队满操作，任务队列不是公平队列时返回false。
+            maxQueueLen为0时只受总长度限制。
+        */
+        bool setTenant(int tenant, int weight, int maxQueueLen = 0);
+        bool setTenant(int tenant, int weight, int maxQueueLen, FullOperate fo);
+
+        PoolConfig getConfig();
+        /*
+            运行中修改参数，不停止线程池，不阻塞提交者。
+            线程数：HUNGER立即补足到minThreads，超出上限的线程由dynamicScale在当前任务执行完后逐个回收。
+            队列长度或类型变化时换新队列，排队中的任务迁移过去(迁移的任务与新提交的任务之间不保证先后)，
+            公平队列之间迁移保留租户和租户配置。新队列放不下时等待worker腾出位置，因此不能在本线程池的任务中缩小队列。
+            本地槽位数量在构造时确定，超出构造时线程上限的worker不使用本地槽位。
+        */
+        void reconfigure(const PoolConfig& config);
+
+        /*
+            持久化队列，任务描述为handler编号加字节负载，先追加到mmap的环形日志文件再入队，执行完后确认。
+            进程重启后同样注册handler，openDurable重放所有未确认的任务，语义为至少一次，handler应当幂等。
+            handler抛出异常时任务同样被确认，异常交给future；ABORT丢弃的任务不确认，下次打开时重放。
+            openDurable需要在注册handler、start之后调用，不能在本线程池的任务中调用，返回重放的任务数。
+        */
+        void registerHandler(uint32_t id, DurableHandler handler);
+        size_t openDurable(const std::string& path, const DurableOptions& options = DurableOptions());
+        //日志空间不足时按FullOperate处理；handler未注册抛std::invalid_argument
+        std::future<void> submitDurable(uint32_t handler, const std::string& payload);
+
+        /*
+            多进程worker：fork n个进程，任务描述(handler编号加负载)经共享内存环交给worker进程执行，结果经环返回。
+            某个任务让worker进程崩溃时只有这个任务的future失败(ProcessCrashedException)，进程立即被重启；
+            handler抛出的异常以ProcessTaskException交给future。handler需要在startProcesses之前注册。
+            shutdown时DRAIN等待已分配给worker进程的任务执行完，ABORT或DRAIN超时直接杀掉worker进程。
+        */
+        void registerProcessHandler(uint32_t id, ProcessHandler handler);
+        void startProcesses(int n, const ProcessOptions& options = ProcessOptions());
+        //所有worker的请求环都满时按FullOperate处理；handler未注册抛std::invalid_argument
+        std::future<std::string> submitProcess(uint32_t handler, const std::string& payload);
+        long long getProcessRestarts();
     private:
         void dynamicScale(){
-            while(1){
+            std::unique_lock<std::mutex> lock(mtxOfThreads);
+            while(!isShutDown.load()){
                 // std::cout << "dynamicScale" << std::endl;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                {
-                    std::lock_guard<std::mutex> lock(mtxOfThreads);
-                    if(size < minSize) continue;
-                    
-                    //空闲
-                    if(size > minSize && blockedThreads.load() > freeThred){
+                //reconfigure调低上限后不等待，逐个回收多出的线程
+                bool over = size > (maxSize > minSize ? maxSize : minSize);
+                if(!over){
+                    cvOfScaler.wait_for(lock, std::chrono::milliseconds(1000));
+                }
+                if(isShutDown.load()) break;
+                if(size < minSize) continue;
+                over = size > (maxSize > minSize ? maxSize : minSize);
+                
+                //空闲或超出上限
+                if(over || (size > minSize && blockedThreads.load() > freeThred)){
+                    {
+                        std::lock_guard<std::mutex> qlock(mtxOfTaskQueuePtr);
                         freeId = size-1;
-                        
-                        cvOfTaskQueuePtr.notify_all();
-                        if(threads[size-1].joinable()){
-                            threads[size-1].join();
-                        }
-                        
+                    }
+                    
+                    cvOfTaskQueuePtr.notify_all();
+                    scalerJoining.store(true);
+                    if(threads[size-1].joinable()){
+                        threads[size-1].join();
+                    }
+                    scalerJoining.store(false);
+                    if(spareDeficit.exchange(false)){
+                        std::lock_guard<std::mutex> slock(mtxOfSpare);
+                        addSpares();
+                    }
+                    
+                    {
+                        std::lock_guard<std::mutex> qlock(mtxOfTaskQueuePtr);
                         freeId = -1;
-                        --size;
-                        threads.resize(size);
-                        std::cout << "size-1" << std::endl;
-                    }else if(size < maxSize && taskQueuePtr->size() > busyThred){  //忙碌
-                        threads.push_back( std::move(std::thread(ThreadWork(this, size))) );
-                        ++size;
-                        std::cout << "size+1" << std::endl;
                     }
+                    --size;
+                    threads.resize(size);
+                    std::cout << "size-1" << std::endl;
+                }else if(size + liveSpares.load() < maxSize && QueueRef(*this)->size() > busyThred){  //忙碌
+                    threads.push_back(spawnWorker(size));
+                    ++size;
+                    std::cout << "size+1" << std::endl;
                 }
             }
         }
@@ -182,6 +613,7 @@ class ComposeThreadPool: public ThreadPool{
             
             
             //入队，同步
+            pendingTasks.fetch_add(1);
             while(!urgTaskQueuePtr->enqueue(std::move(callBack))) {}
             // 不需要唤醒线程
             // cvOfTaskQueuePtr.notify_one();
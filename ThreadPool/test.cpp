@@ -4,7 +4,18 @@
 #include <random>
 #include <ctime>
 
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <csignal>
+
 #include "ThreadPool.h"
+#include "Strand.h"
+#include "Channel.h"
+#include "Pipeline.h"
 
 using namespace std;
 
@@ -290,10 +301,838 @@ void FunctionalTest(){
     }
 }
 
+void BlockingTest(){
+    // 2个worker都进入阻塞区域，补偿线程继续执行小任务
+    ThreadPool pool(2, 4);
+    pool.start();
+    for(int i = 0; i < 2; ++i){
+        pool.submit([&pool](){
+            pool.blocking([](){ FuncSleep(500); });
+        });
+    }
+    FuncSleep(10);
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < 20; ++i){
+        pool.submit(FuncLittle);
+    }
+    auto res = pool.submit(LastFunc);
+    res.get();
+    auto end = std::chrono::high_resolution_clock::now();
+    int us = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+    std::cout << "BlockingTest cost time: " << us/1000.0 << std::endl;
+    pool.shutdown();
+}
+
+void IoTest(IoBackend backend){
+    ThreadPool pool(2);
+    pool.setIoBackend(backend);
+    pool.start();
+    cout << "backend " << (pool.getIoBackend() == IoBackend::IO_URING ? "io_uring" : "epoll") << endl;
+
+    // 临时文件：先写后读
+    char path[] = "/tmp/threadpool_io_XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    const char msg[] = "hello reactor";
+    std::promise<ssize_t> wrote;
+    pool.asyncWrite(fd, msg, sizeof(msg), [&wrote](ssize_t n){ wrote.set_value(n); }, 0);
+    cout << "file write " << wrote.get_future().get() << endl;
+    char buf[64] = {0};
+    std::promise<ssize_t> read;
+    pool.asyncRead(fd, buf, sizeof(buf), [&read](ssize_t n){ read.set_value(n); }, 0);
+    cout << "file read " << read.get_future().get() << " " << buf << endl;
+    close(fd);
+
+    // socketpair：先挂起读，再写另一端
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    char sbuf[64] = {0};
+    std::promise<ssize_t> recv;
+    pool.asyncRead(sv[0], sbuf, sizeof(sbuf), [&recv](ssize_t n){ recv.set_value(n); });
+    FuncSleep(10);
+    pool.asyncWrite(sv[1], msg, sizeof(msg), [](ssize_t){});
+    cout << "socket read " << recv.get_future().get() << " " << sbuf << endl;
+    close(sv[0]);
+    close(sv[1]);
+    pool.shutdown();
+}
+
+void FairTest(TaskQueueType tt){
+    // 租户1先灌满50个任务，租户2(权重2)随后提交5个，租户2不应排在租户1全部任务之后
+    ThreadPool pool(1, 0, 100, 0, 0, InitType::HUNGER, tt);
+    pool.setTenant(1, 1, 50);
+    pool.setTenant(2, 2, 10, FullOperate::EXCEPTION);
+    pool.start();
+    std::mutex mtx;
+    std::string order;
+    auto record = [&mtx, &order](char c){
+        std::lock_guard<std::mutex> lock(mtx);
+        order.push_back(c);
+    };
+    pool.submit(FuncSleep, 50);
+    for(int i = 0; i < 60; ++i){
+        pool.submit(Tenant{1}, record, '1');
+    }
+    for(int i = 0; i < 5; ++i){
+        pool.submit(Tenant{2}, record, '2');
+    }
+    pool.submit(Tenant{1}, LastFunc);
+    auto res = pool.submit(Tenant{2}, LastFunc);
+    res.get();
+    FuncSleep(10);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        cout << order << endl;
+    }
+    pool.shutdown();
+}
+
+void FairFloodTest(TaskQueueType tt){
+    // 租户1未单独配置，持续提交直到被拒绝；之后租户2仍能提交成功
+    ThreadPool pool(1, 0, 64, 0, 0, InitType::HUNGER, tt);
+    pool.start();
+    pool.submit(FuncSleep, 50);
+    FuncSleep(5);
+    int accepted = 0;
+    while(pool.submit(Tenant{1}, FuncLittle).valid()){
+        ++accepted;
+    }
+    auto res = pool.submit(Tenant{2}, LastFunc);
+    cout << "FairFloodTest tenant1 " << accepted << " tenant2 " << (res.valid() ? "accepted" : "rejected") << endl;
+    pool.shutdown();
+}
+
+void StrandTest(){
+    // 4个提交线程向同一个Strand提交，任务不并发，同一提交者的任务保持顺序
+    ThreadPool pool(4, 0, 1000);
+    pool.start();
+    Strand strand(pool);
+    int counter = 0;
+    std::atomic<bool> running(false);
+    std::atomic<bool> overlap(false), disorder(false);
+    vector<int> last(4, -1);
+    vector<thread> submitters;
+    for(int t = 0; t < 4; ++t){
+        submitters.push_back(thread([&, t](){
+            for(int i = 0; i < 10000; ++i){
+                strand.submit([&, t, i](){
+                    if(running.exchange(true)) overlap.store(true);
+                    if(last[t] != i - 1) disorder.store(true);
+                    last[t] = i;
+                    ++counter;
+                    running.store(false);
+                });
+            }
+        }));
+    }
+    for(auto& th: submitters){
+        th.join();
+    }
+    strand.submit(LastFunc).get();
+    cout << "StrandTest counter " << counter << " overlap " << overlap.load() << " disorder " << disorder.load() << endl;
+    pool.shutdown();
+}
+
+void SaturatedPostTest(){
+    // 1个worker、队列长度4，外部线程一直把队列占满；worker中Strand的续投不能自旋等只有它自己能腾出的位置
+    ThreadPool pool(1, 0, 4);
+    pool.start();
+    Strand strand(pool, 1);
+    std::atomic<bool> stop(false);
+    std::thread filler([&](){
+        while(!stop.load()) pool.submit(FuncSleep, 1);
+    });
+    vector<std::future<void>> futures;
+    for(int i = 0; i < 100; ++i){
+        futures.push_back(strand.submit([](){}));
+    }
+    int done = 0;
+    for(auto& f: futures){
+        if(f.wait_for(std::chrono::seconds(3)) == std::future_status::ready) ++done;
+    }
+    stop.store(true);
+    filler.join();
+    cout << "SaturatedPostTest strand done " << done << " of 100" << endl;
+    pool.shutdown();
+}
+
+void OverloadTest(bool admission){
+    // 4个线程每个任务2ms，服务能力约2000/s；以4000/s提交2秒，任务截止时间50ms
+    ThreadPool pool(4, 0, 10000);
+    if(admission){
+        pool.setAdmissionControl(std::chrono::milliseconds(5));
+    }
+    pool.start();
+    vector<std::future<void>> futures;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < 8000; ++i){
+        std::this_thread::sleep_until(start + std::chrono::microseconds(250 * i));
+        futures.push_back(pool.submit(Deadline::after(std::chrono::milliseconds(50)), FuncSleep, 2));
+    }
+    int done = 0, timeout = 0, rejected = 0;
+    for(auto& res: futures){
+        if(!res.valid()){
+            ++rejected;
+            continue;
+        }
+        try{
+            res.get();
+            ++done;
+        }catch (TaskTimeoutException& e){
+            ++timeout;
+        }
+    }
+    cout << "OverloadTest admission " << admission << " done " << done << " timeout " << timeout << " rejected " << rejected << endl;
+    pool.shutdown();
+}
+
+void CancelTest(){
+    // 1个线程，第一个任务运行中轮询token；整批500个排队任务随source一起取消
+    ThreadPool pool(1, 0, 1000);
+    pool.start();
+    CancellationSource batch;
+    std::atomic<int> ran(0);
+    auto first = pool.submit(batch.token(), [&ran](){
+        while(!ThreadPool::cancellationRequested()){
+            FuncSleep(1);
+        }
+        ++ran;
+    });
+    vector<std::future<void>> futures;
+    for(int i = 0; i < 500; ++i){
+        futures.push_back(pool.submit(batch.token(), [&ran](){ ++ran; }));
+    }
+    FuncSleep(20);
+    batch.cancel();
+    first.get();
+    int cancelled = 0;
+    for(auto& res: futures){
+        try{
+            res.get();
+        }catch (TaskCancelledException& e){
+            ++cancelled;
+        }
+    }
+    cout << "CancelTest ran " << ran.load() << " cancelled " << cancelled << endl;
+    pool.shutdown();
+}
+
+void ShutdownTest(){
+    {// DRAIN：最后一个任务完成即返回，动态调整线程也被join
+        ThreadPool pool(4, 8);
+        pool.start();
+        for(int i = 0; i < 8; ++i){
+            pool.submit(FuncSleep, 50);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        bool drained = pool.shutdown(ShutdownMode::DRAIN, std::chrono::milliseconds(1000));
+        auto end = std::chrono::high_resolution_clock::now();
+        int us = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+        cout << "drain " << drained << " cost time: " << us/1000.0 << endl;
+    }
+    {// ABORT：排队任务立即broken_promise
+        ThreadPool pool(1, 0, 200);
+        pool.start();
+        vector<std::future<void>> futures;
+        for(int i = 0; i < 100; ++i){
+            futures.push_back(pool.submit(FuncSleep, 10));
+        }
+        FuncSleep(5);
+        auto start = std::chrono::high_resolution_clock::now();
+        pool.shutdown(ShutdownMode::ABORT);
+        auto end = std::chrono::high_resolution_clock::now();
+        int us = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+        int broken = 0;
+        for(auto& res: futures){
+            try{
+                res.get();
+            }catch (std::future_error& e){
+                ++broken;
+            }
+        }
+        cout << "abort broken " << broken << " cost time: " << us/1000.0 << endl;
+    }
+}
+
+void LocalChain(ThreadPool& pool, int depth, std::thread::id parent, std::atomic<int>& same, std::promise<void>& done){
+    if(std::this_thread::get_id() == parent) ++same;
+    if(depth == 0){
+        done.set_value();
+        return;
+    }
+    pool.submit(LocalChain, std::ref(pool), depth - 1, std::this_thread::get_id(), std::ref(same), std::ref(done));
+}
+
+void LocalSlotTest(){
+    // 任务链中每个子任务由父任务提交，统计在同一个worker上执行的比例
+    ThreadPool pool(4, 0, 1000);
+    pool.start();
+    std::atomic<int> same(0);
+    std::promise<void> done;
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.submit(LocalChain, std::ref(pool), 100000, std::thread::id(), std::ref(same), std::ref(done));
+    done.get_future().get();
+    auto end = std::chrono::high_resolution_clock::now();
+    int us = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+    cout << "LocalSlotTest same worker " << same.load() << "/100000 cost time: " << us/1000.0 << endl;
+    pool.shutdown();
+}
+
+
+void SlotStealTest(){
+    // 共享队列持续有任务时，父任务提交子任务(进入本worker槽位)后阻塞等待，子任务应被其他worker偷走执行
+    ThreadPool pool(4, 0, 20000);
+    pool.start();
+    for(int i = 0; i < 1000; ++i){
+        pool.submit(FuncSleep, 1);
+    }
+    auto parent = pool.submit([&pool](){
+        auto start = std::chrono::steady_clock::now();
+        auto child = pool.submit(LastFunc);
+        bool ready = child.wait_for(std::chrono::seconds(3)) == std::future_status::ready;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        return ready ? ms : -1L;
+    });
+    for(int i = 0; i < 10000; ++i){
+        pool.submit(FuncSleep, 1);
+    }
+    long ms = parent.get();
+    cout << "SlotStealTest child waited " << ms << "ms" << (ms < 0 ? " (timeout)" : "") << endl;
+    pool.shutdown(ShutdownMode::ABORT);
+}
+
+void ReconfigTest(){
+    // 提交者持续提交，期间多次更换队列类型、长度和线程数，检查任务不丢失
+    ThreadPool pool(2, 0, 1000);
+    pool.start();
+    std::atomic<int> done(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> submitters;
+    std::atomic<int> submitted(0);
+    for(int i = 0; i < 4; ++i){
+        submitters.emplace_back([&](){
+            while(!stop.load()){
+                if(pool.submit([&](){ done.fetch_add(1); }).valid()){
+                    submitted.fetch_add(1);
+                }else{
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    PoolConfig cfg = pool.getConfig();
+    TaskQueueType types[] = {TaskQueueType::BLOCK_QUEUE, TaskQueueType::FAIR_DRR, TaskQueueType::BLOCK_RINGBUFFER,
+                             TaskQueueType::LOCKFREE_QUEUE, TaskQueueType::FAIR_WFQ, TaskQueueType::LOCKFREE_RINGBUFFER};
+    int lens[] = {10000, 200, 64, 5000, 300, 100};
+    int mins[] = {4, 8, 1, 2, 6, 3};
+    for(int i = 0; i < 6; ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        cfg.queueType = types[i];
+        cfg.maxQueueLen = lens[i];
+        cfg.minThreads = mins[i];
+        cfg.maxThreads = mins[i] + 2;
+        cfg.busyThreshold = cfg.freeThreshold = 0;
+        pool.reconfigure(cfg);
+        PoolConfig now = pool.getConfig();
+        cout << "reconfigure len " << now.maxQueueLen << " threads " << now.minThreads << "-" << now.maxThreads
+             << " busy " << now.busyThreshold << " free " << now.freeThreshold << endl;
+    }
+    stop.store(true);
+    for(auto& th: submitters){
+        th.join();
+    }
+    pool.shutdown();
+    cout << "ReconfigTest submitted " << submitted.load() << " done " << done.load() << endl;
+}
+
+void ThreadAttrTest(){
+    // 线程名、各通道nice值，以及HUNGER创建256个线程的耗时
+    ComposeThreadPool pool(10, 4);
+    ThreadAttr attr;
+    attr.stackSize = 256 * 1024;
+    attr.nice = 5;
+    pool.setThreadName("attr");
+    pool.setThreadAttr(ThreadLane::WORKER, attr);
+    attr.nice = 0;
+    pool.setThreadAttr(ThreadLane::URGENT, attr);
+    pool.start();
+    auto probe = [](){
+        char name[16];
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        return std::string(name) + " nice " + std::to_string(getpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid))));
+    };
+    cout << pool.urgSubmit(probe).get() << endl;
+    cout << pool.submit(probe).get() << endl;
+    pool.shutdown();
+
+    for(size_t stack: {size_t(0), size_t(256 * 1024)}){
+        ThreadPool big(256);
+        ThreadAttr a;
+        a.stackSize = stack;
+        big.setThreadAttr(ThreadLane::WORKER, a);
+        auto start = std::chrono::high_resolution_clock::now();
+        big.start();
+        auto end = std::chrono::high_resolution_clock::now();
+        int us = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+        cout << "ThreadAttrTest stack " << stack << " start 256 threads cost time: " << us/1000.0 << endl;
+        big.shutdown();
+    }
+}
+
+void LaneInheritTest(){
+    // 只设置URGENT通道的nice，其他worker由0号worker创建，应保持调用start的线程的nice(nice -n 10运行时为10)
+    ComposeThreadPool pool(8, 4);
+    ThreadAttr attr;
+    attr.nice = 15;
+    pool.setThreadAttr(ThreadLane::URGENT, attr);
+    int base = getpriority(PRIO_PROCESS, 0);
+    pool.start();
+    // 0号worker也执行普通任务，按线程名区分通道
+    auto probe = [](){
+        FuncSleep(20);
+        char name[16];
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        return std::make_pair(std::string(name), getpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid))));
+    };
+    int urgent = pool.urgSubmit(probe).get().second;
+    vector<std::future<std::pair<std::string, int>>> futures;
+    for(int i = 0; i < 16; ++i){
+        futures.push_back(pool.submit(probe));
+    }
+    int workers = 0, inherited = 0;
+    for(auto& res: futures){
+        auto r = res.get();
+        if(r.first.find("-u") != std::string::npos) continue;
+        ++workers;
+        if(r.second != base) ++inherited;
+    }
+    cout << "LaneInheritTest base nice " << base << " urgent nice " << urgent << " worker tasks " << workers << " not default " << inherited << endl;
+    pool.shutdown();
+}
+
+void ChannelConsume(ThreadPool& pool, Channel<int>& ch, std::atomic<long long>& sum, std::atomic<int>& finished){
+    ch.asyncRecv(pool, [&](std::optional<int> v){
+        if(!v){
+            finished.fetch_add(1);
+            return;
+        }
+        sum.fetch_add(*v);
+        ChannelConsume(pool, ch, sum, finished);
+    });
+}
+
+void ChannelTest(){
+    // 2个worker上挂4个异步接收循环，线程外阻塞发送
+    ThreadPool pool(2);
+    pool.start();
+    Channel<int> ch(8);
+    std::atomic<long long> sum(0);
+    std::atomic<int> finished(0);
+    for(int i = 0; i < 4; ++i){
+        ChannelConsume(pool, ch, sum, finished);
+    }
+    std::vector<std::thread> producers;
+    for(int i = 0; i < 2; ++i){
+        producers.emplace_back([&ch](){
+            for(int v = 0; v < 50000; ++v) ch.send(v);
+        });
+    }
+    for(auto& th: producers){
+        th.join();
+    }
+    ch.close();
+    while(finished.load() < 4) std::this_thread::yield();
+    cout << "ChannelTest sum " << sum.load() << " expect " << 2LL * 49999 * 50000 / 2 << endl;
+
+    // 线程池中异步发送，主线程select三个通道
+    Channel<int> a(4), b(4), quit(1);
+    int fromA = 0, fromB = 0;
+    bool stop = false;
+    std::atomic<int> sent(0);
+    for(int i = 0; i < 1000; ++i){
+        a.asyncSend(pool, i, [&](bool ok){ if(ok && sent.fetch_add(1) == 1999) quit.trySend(0); });
+        b.asyncSend(pool, i, [&](bool ok){ if(ok && sent.fetch_add(1) == 1999) quit.trySend(0); });
+    }
+    while(!stop){
+        Select()
+            .recv(a, [&](std::optional<int> v){ if(v) ++fromA; })
+            .recv(b, [&](std::optional<int> v){ if(v) ++fromB; })
+            .recv(quit, [&](std::optional<int>){ stop = true; })
+            .wait();
+    }
+    int v;
+    while(a.tryRecv(v)) ++fromA;
+    while(b.tryRecv(v)) ++fromB;
+    cout << "ChannelTest select a " << fromA << " b " << fromB << endl;
+
+    // 异步select循环，每次选中后重新挂起，两个通道都关闭后结束
+    Channel<std::string> c(2), d(2);
+    std::atomic<int> got(0), closed(0);
+    std::promise<void> done;
+    std::function<void()> loop = [&](){
+        auto onClose = [&](int bit){
+            int prev = closed.fetch_or(bit);
+            if((prev | bit) == 3){
+                if(prev != 3) done.set_value();
+                return;
+            }
+            loop();
+        };
+        Select()
+            .recv(c, [&, onClose](std::optional<std::string> s){ if(s){ got.fetch_add(1); loop(); } else onClose(1); })
+            .recv(d, [&, onClose](std::optional<std::string> s){ if(s){ got.fetch_add(1); loop(); } else onClose(2); })
+            .async(pool);
+    };
+    loop();
+    for(int i = 0; i < 100; ++i){
+        c.send("c");
+        d.send("d");
+    }
+    c.close();
+    d.close();
+    done.get_future().get();
+    cout << "ChannelTest async select got " << got.load() << endl;
+    pool.shutdown();
+}
+
+void SelectWakeupTest(){
+    // select(a, b)先在a上登记，接收者随后阻塞在a上；a.send唤醒select后b也就绪，
+    // select执行b时要把a的唤醒传给接收者，否则a中有数据而接收者一直睡眠
+    int lost = 0;
+    for(int run = 0; run < 40; ++run){
+        Channel<int> a(1), b(1);
+        std::thread selector([&](){
+            Select()
+                .recv(a, [](std::optional<int>){})
+                .recv(b, [](std::optional<int>){})
+                .wait();
+        });
+        FuncSleep(5);
+        std::atomic<bool> got(false);
+        std::thread receiver([&](){
+            int v;
+            if(a.recv(v)) got.store(true);
+        });
+        FuncSleep(5);
+        a.send(1);
+        b.send(2);
+        selector.join();
+        for(int i = 0; i < 100 && !got.load(); ++i) FuncSleep(1);
+        if(!got.load() && a.size() > 0) ++lost;
+        a.close();
+        receiver.join();
+    }
+    cout << "SelectWakeupTest lost " << lost << " of 40" << endl;
+}
+
+void PipelineTest(){
+    // 串行输入 -> 并行计算 -> 乱序串行统计 -> 有序串行输出，最多8个token
+    ThreadPool pool(4);
+    pool.start();
+    struct Item{
+        int v;
+        std::thread::id th;
+    };
+    std::atomic<int> inflight(0), peak(0), sameThread(0), overlap(0), inStage(0);
+    int next = 0, counted = 0, expect = 0;
+    bool ordered = true;
+    Pipeline pipe(pool, 8);
+    pipe.source([&]() -> std::optional<Item> {
+            if(next == 20000) return std::nullopt;
+            int now = inflight.fetch_add(1) + 1;
+            int old = peak.load();
+            while(now > old && !peak.compare_exchange_weak(old, now)) {}
+            return Item{next++, std::thread::id()};
+        })
+        .then(StageMode::PARALLEL, [](Item it){
+            volatile int x = 0;
+            for(int i = 0; i < 2000; ++i) x += i;
+            it.v *= 2;
+            it.th = std::this_thread::get_id();
+            return it;
+        })
+        .then(StageMode::SERIAL_OUT_OF_ORDER, [&](Item it){
+            if(inStage.fetch_add(1) != 0) overlap.fetch_add(1);
+            if(it.th == std::this_thread::get_id()) sameThread.fetch_add(1);
+            ++counted;
+            inStage.fetch_sub(1);
+            return it.v;
+        })
+        .then(StageMode::SERIAL_IN_ORDER, [&](int v){
+            if(v != expect * 2) ordered = false;
+            ++expect;
+            inflight.fetch_sub(1);
+        });
+    auto start = std::chrono::steady_clock::now();
+    pipe.run();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    cout << "PipelineTest items " << expect << " counted " << counted << " ordered " << ordered
+         << " peak tokens " << peak.load() << " overlap " << overlap.load()
+         << " same thread " << sameThread.load() << " " << ms << "ms" << endl;
+
+    // 阶段抛出异常后停止输入，run抛出第一个异常
+    int produced = 0;
+    Pipeline bad(pool, 4);
+    bad.source([&]() -> std::optional<int> {
+            if(produced == 100000) return std::nullopt;
+            return produced++;
+        })
+        .then(StageMode::PARALLEL, [](int v){
+            if(v == 1000) throw std::runtime_error("stage failed at 1000");
+            return v;
+        })
+        .then(StageMode::SERIAL_IN_ORDER, [](int){});
+    try{
+        bad.run();
+        cout << "PipelineTest no exception" << endl;
+    }catch(std::exception& e){
+        cout << "PipelineTest " << e.what() << ", produced " << produced << endl;
+    }
+    pool.shutdown();
+
+    // 单worker、队列长度8：token走完后循环取输入，不递归也不堆积投递的任务
+    ThreadPool single(1, 0, 8);
+    single.start();
+    int fed = 0;
+    long long sum = 0;
+    Pipeline small(single, 4);
+    small.source([&]() -> std::optional<int> {
+            if(fed == 100000) return std::nullopt;
+            return fed++;
+        })
+        .then(StageMode::PARALLEL, [](int v){ return v + 1; })
+        .then(StageMode::SERIAL_IN_ORDER, [&](int v){ sum += v; });
+    start = std::chrono::steady_clock::now();
+    small.run();
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    cout << "PipelineTest single worker items " << fed << " sum " << sum << " " << ms << "ms" << endl;
+    single.shutdown();
+}
+
+void DurableTest(){
+    // 模拟崩溃：worker卡在第一个任务上时ABORT，排队中的任务没有确认
+    const char* path = "/tmp/threadpool_durable.log";
+    unlink(path);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    {
+        ThreadPool pool(1, 0, 2000);
+        pool.registerHandler(1, [opened](const std::string&){ opened.wait(); });
+        pool.start();
+        pool.openDurable(path);
+        for(int i = 0; i < 1000; ++i){
+            pool.submitDurable(1, std::to_string(i));
+        }
+        std::thread releaser([&gate](){
+            FuncSleep(50);
+            gate.set_value();
+        });
+        pool.shutdown(ShutdownMode::ABORT);
+        releaser.join();
+    }
+
+    // 重启后重放未确认的任务
+    std::atomic<long long> sum(0);
+    std::atomic<int> runs(0);
+    {
+        ThreadPool pool(4);
+        pool.registerHandler(1, [&](const std::string& payload){
+            sum.fetch_add(std::stoll(payload));
+            runs.fetch_add(1);
+        });
+        pool.start();
+        auto start = std::chrono::steady_clock::now();
+        size_t replayed = pool.openDurable(path);
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        pool.shutdown();
+        cout << "DurableTest replayed " << replayed << " runs " << runs.load() << " sum " << sum.load()
+             << " expect " << 999LL * 1000 / 2 << " open " << us << "us" << endl;
+    }
+
+    // 64KB日志反复绕回，日志满时拒绝；全部确认后再打开没有需要重放的任务
+    unlink(path);
+    int accepted = 0;
+    {
+        ThreadPool pool(4, 0, 20000);
+        pool.registerHandler(1, [](const std::string&){});
+        pool.start();
+        DurableOptions opt;
+        opt.capacity = 64 << 10;
+        opt.sync = DurableSync::ALWAYS;
+        pool.openDurable(path, opt);
+        std::vector<std::future<void>> futures;
+        for(int i = 0; i < 20000; ++i){
+            std::future<void> f = pool.submitDurable(1, std::string(100 + i % 37, 'x'));
+            if(f.valid()) futures.push_back(std::move(f));
+        }
+        accepted = int(futures.size());
+        for(auto& f: futures){
+            f.get();
+        }
+        pool.shutdown();
+    }
+    {
+        ThreadPool pool(1);
+        pool.registerHandler(1, [](const std::string&){});
+        pool.start();
+        cout << "DurableTest accepted " << accepted << ", replayed after ack " << pool.openDurable(path) << endl;
+    }
+
+    // 刷盘策略的提交开销
+    for(DurableSync mode: {DurableSync::NONE, DurableSync::BATCH, DurableSync::ALWAYS}){
+        unlink(path);
+        ThreadPool pool(2, 0, 20000);
+        pool.registerHandler(1, [](const std::string&){});
+        pool.start();
+        DurableOptions opt;
+        opt.sync = mode;
+        pool.openDurable(path, opt);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < 10000; ++i){
+            pool.submitDurable(1, "payload");
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        cout << "DurableTest sync " << int(mode) << " " << us / 10000.0 << "us per submit" << endl;
+        pool.shutdown();
+    }
+    unlink(path);
+}
+
+void ProcessTest(){
+    // 3个worker进程：正常任务、抛异常的任务、让进程崩溃的任务混在一起
+    ThreadPool pool(2);
+    pool.registerProcessHandler(1, [](const std::string& payload){
+        return std::string(payload.rbegin(), payload.rend());
+    });
+    pool.registerProcessHandler(2, [](const std::string&) -> std::string {
+        raise(SIGSEGV);
+        return "";
+    });
+    pool.registerProcessHandler(3, [](const std::string& payload) -> std::string {
+        throw std::runtime_error("bad payload " + payload);
+    });
+    pool.registerProcessHandler(4, [](const std::string&){
+        return std::to_string(getpid());
+    });
+    pool.registerProcessHandler(5, [](const std::string& payload){
+        usleep(200);
+        return payload;
+    });
+    pool.start();
+    pool.startProcesses(3);
+
+    std::vector<std::future<std::string>> futures;
+    for(int i = 0; i < 10000; ++i){
+        if(i % 2000 == 1){
+            futures.push_back(pool.submitProcess(2, ""));
+        }else if(i % 2000 == 2){
+            futures.push_back(pool.submitProcess(3, std::to_string(i)));
+        }else{
+            futures.push_back(pool.submitProcess(1, std::to_string(i)));
+        }
+    }
+    int ok = 0, wrong = 0, crashed = 0, thrown = 0, rejected = 0;
+    for(int i = 0; i < 10000; ++i){
+        if(!futures[i].valid()){
+            ++rejected;
+            continue;
+        }
+        try{
+            std::string s = futures[i].get();
+            std::string expect = std::to_string(i);
+            if(s == std::string(expect.rbegin(), expect.rend())) ++ok;
+            else ++wrong;
+        }catch(ProcessCrashedException& e){
+            if(crashed == 0) cout << "ProcessTest " << e.what() << endl;
+            ++crashed;
+        }catch(ProcessTaskException& e){
+            ++thrown;
+        }
+    }
+    std::string pid = pool.submitProcess(4, "").get();
+    cout << "ProcessTest ok " << ok << " wrong " << wrong << " crashed " << crashed << " thrown " << thrown
+         << " rejected " << rejected << " restarts " << pool.getProcessRestarts()
+         << " worker pid " << pid << " parent pid " << getpid() << endl;
+
+    // 任务执行中从外部反复杀worker，每个future都要完成或按崩溃失败，不能一直挂起
+    futures.clear();
+    for(int round = 0; round < 20; ++round){
+        pid_t victim = std::stoi(pool.submitProcess(4, "").get());
+        for(int i = 0; i < 200; ++i){
+            futures.push_back(pool.submitProcess(5, std::to_string(i)));
+        }
+        FuncSleep(5);
+        kill(victim, SIGKILL);
+    }
+    int finished = 0, hung = 0;
+    crashed = 0;
+    for(auto& f: futures){
+        if(!f.valid()) continue;
+        if(f.wait_for(std::chrono::seconds(5)) != std::future_status::ready){
+            ++hung;
+            continue;
+        }
+        try{
+            f.get();
+            ++finished;
+        }catch(ProcessCrashedException& e){
+            ++crashed;
+        }
+    }
+    cout << "ProcessTest killed finished " << finished << " crashed " << crashed << " hung " << hung << endl;
+    pool.shutdown();
+
+    // DRAIN的timeout也限制进程任务：超时后杀掉worker，shutdown返回false
+    ThreadPool slow(1);
+    slow.registerProcessHandler(1, [](const std::string& payload){
+        sleep(3);
+        return payload;
+    });
+    slow.start();
+    slow.startProcesses(1);
+    std::future<std::string> running = slow.submitProcess(1, "x");
+    std::future<std::string> queued = slow.submitProcess(1, "y");
+    FuncSleep(50);
+    auto start = std::chrono::steady_clock::now();
+    bool drained = slow.shutdown(ShutdownMode::DRAIN, std::chrono::milliseconds(100));
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    int failed = 0;
+    for(auto* f: {&running, &queued}){
+        try{
+            f->get();
+        }catch(ProcessCrashedException& e){
+            ++failed;
+        }
+    }
+    cout << "ProcessTest drain timeout returned " << drained << " after " << ms << "ms, failed " << failed << endl;
+}
 
 int main(){
 
     // FunctionalTest();
+    // BlockingTest();
+    // IoTest(IoBackend::AUTO);
+    // IoTest(IoBackend::EPOLL);
+    // FairTest(TaskQueueType::FAIR_DRR);
+    // FairTest(TaskQueueType::FAIR_WFQ);
+    // StrandTest();
+    // OverloadTest(false);
+    // OverloadTest(true);
+    // CancelTest();
+    // ShutdownTest();
+    // LocalSlotTest();
+    // ReconfigTest();
+    // ThreadAttrTest();
+    // ChannelTest();
+    // PipelineTest();
+    // DurableTest();
+    // ProcessTest();
+    // FairFloodTest(TaskQueueType::FAIR_DRR);
+    // FairFloodTest(TaskQueueType::FAIR_WFQ);
+    // LaneInheritTest();
+    // SelectWakeupTest();
+    // SaturatedPostTest();
+    // SlotStealTest();
     // ThreadPool pool(4, 0, 1100, 0, 0, InitType::HUNGER, TaskQueueType::LOCKFREE_RINGBUFFER);
     // pool.start();
 